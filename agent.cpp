@@ -4,10 +4,7 @@
 #include <string>
 #include <stdlib.h>
 #include "agent.h"
-
-#include "MERSENNE_TWISTER.h"
-MERSENNE_TWISTER twister(time(NULL));
-
+#include "prng.h"
 
 using namespace std;
 
@@ -28,7 +25,7 @@ int RandomComputerAgent::policy(Position& pos)
     Bitboard all_moves = pos.generate_moves(side);
     if (!all_moves) return -1;
     vector<int> moves = pos.bb2vec(all_moves);
-    int random_choice = twister.randInt(moves.size() - 1);
+    int random_choice = thread_random().below(moves.size());
     return moves[random_choice];
 }
 
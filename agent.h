@@ -2,9 +2,14 @@
 #define AGENT_H
 
 #include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iosfwd>
 #include <fdeep/fdeep.hpp>
 #include "bitboard.h"
 #include "position.h"
+#include "prng.h"
 
 
 // class for an AI Agent that plays the game
@@ -47,8 +52,90 @@ private:
 
 // used to support MC tree structure
 struct TreeNode;
+struct PathStep;
+class NodeArena;
+class TranspositionTable;
+class Solver;
+class TimeManager;
 // wrapper for a rollout policy function; type of function is "Rollout"
-typedef int (*Rollout)(Position& pos);
+// rollouts play out the compact board in place and return the game outcome
+typedef int (*Rollout)(Board& pos);
+// a rollout policy that plays k games from pos at once and returns the sum of the outcomes
+typedef int (*LaneRollout)(const Board& pos, int k);
+
+
+// how the threads of MCTSComputerAgent share the work
+// ROOT: each thread grows an independent tree from the current position, and the root
+//       statistics of all trees are merged to pick the move
+// TREE: all threads grow one tree, with atomic statistics and virtual loss
+enum MCTSParallel : int {
+    PARALLEL_ROOT, PARALLEL_TREE
+};
+
+
+// settings for MCTSComputerAgent; the defaults give a single-threaded search
+struct MCTSOptions {
+    // how many rollouts to conduct per move, in total over all threads
+    uint32_t iterations = 10000;
+    // if positive, ignore iterations and search by time instead: this many seconds for
+    // all of the agent's moves in the game, split over the moves by a TimeManager
+    double game_time = 0;
+    // number of threads searching
+    int threads = 1;
+    // how the threads share the work
+    MCTSParallel parallel = PARALLEL_ROOT;
+    // with PARALLEL_TREE, a thread descending into a node counts as this many lost
+    // rollouts there until its own rollout finishes
+    int virtual_loss = 1;
+    // keep searching on a background thread while the opponent thinks, from the position
+    // after our move, until the opponent's move is acknowledged (for at most iterations
+    // more iterations, or until then when searching by time)
+    bool ponder = false;
+    // share the children of nodes that reach the same position by different move orders,
+    // found through a transposition table (one per tree) of table_size entries
+    bool transpositions = false;
+    size_t table_size = 1 << 20;
+    // if positive, the most memory the nodes of all trees may take, in bytes: when the
+    // trees come near it, their least visited subtrees are turned back into leaves at the
+    // start of a search, and a search that still runs out stops expanding nodes
+    // only the nodes count: the transposition and solver tables have fixed sizes of their own
+    size_t memory_limit = 0;
+    // if positive, positions with at most this many empty squares are solved exactly instead
+    // of rolled out, and proven outcomes propagate up the trees so that proven subtrees are
+    // not searched again; a move from such a position is found by the solver alone
+    int solve_empties = 0;
+    // if above 1, every iteration plays this many rollouts from its leaf at once with
+    // lane_rollout, instead of one with the agent's policy, and counts as that many visits
+    int leaf_rollouts = 1;
+    LaneRollout lane_rollout = NULL;
+    // stop a search by iterations once the runner-up root move would need more than this
+    // fraction of the remaining iterations to catch up with the most visited one, and play
+    // a single legal move without searching; 1 stops only when the most visited move can no
+    // longer change, less stops sooner, and 0 always searches the whole budget
+    double settle_fraction = 1.0;
+    // if set, a JSON record of every move's search (see MCTSComputerAgent::telemetry) is
+    // written to this stream, one per line; agents may share a stream
+    std::ostream *telemetry = NULL;
+};
+
+
+// how well the transposition tables of MCTSComputerAgent are doing, summed over all trees
+struct TranspositionStats {
+    uint64_t lookups;       // expansions that looked for a transposition
+    uint64_t hits;          // ... and found one, linking to it instead of expanding
+    uint64_t saved_bytes;   // memory of the child blocks the links did not allocate
+    uint64_t table_bytes;   // memory of the tables themselves
+    uint64_t tree_bytes;    // memory reserved for the nodes of the trees
+};
+
+
+// how much searching MCTSComputerAgent saved by stopping early, over all its moves
+struct EarlyStopStats {
+    uint64_t budget;        // iterations given to the searches by iterations
+    uint64_t saved;         // ... that were not run, the searches having stopped early
+    uint64_t settled;       // searches stopped early
+    uint64_t single_moves;  // moves played without a search, being the only legal one
+};
 
 
 // a computer AI that uses Monte Carlo Tree Search for policy
@@ -57,19 +144,90 @@ public:
     // constructor
     // user must specify a function for the Rollout policy!
     MCTSComputerAgent(Color c, uint32_t iterations, Rollout f);
+    MCTSComputerAgent(Color c, const MCTSOptions& options, Rollout f);
     // destructor
     ~MCTSComputerAgent();
     // after a move has been made, preserve relevant search tree branches
     void acknowledge_move(int move);
+    // change how many rollouts to conduct per move; the search tree is kept
+    void set_iterations(uint32_t n) { options.iterations = n; }
+    // statistics of the transposition tables since the agent was created
+    TranspositionStats transposition_stats(void);
+    // how much searching was saved by stopping early since the agent was created
+    EarlyStopStats early_stop_stats(void) { return early_stop; }
+    // memory taken by the nodes of the trees, in bytes
+    size_t memory_used(void);
 private:
-    // how many rollouts to conduct during MCTS
-    uint32_t iterations;
-    // store the search tree from previous MCTS iterations
-    TreeNode *tree;
-    // policy function that returns the best move given a position
+    // how many rollouts (or how much time) to spend during MCTS, and on how many threads
+    MCTSOptions options;
+    // store the search trees from previous MCTS iterations
+    // one per thread with PARALLEL_ROOT, a single shared one with PARALLEL_TREE
+    std::vector<TreeNode*> trees;
+    // where the nodes are allocated, one arena per tree
+    std::vector<NodeArena*> arenas;
+    // the transposition table of every tree, if enabled
+    std::vector<TranspositionTable*> tables;
+    // the endgame solver of every thread, if enabled
+    std::vector<Solver*> solvers;
+    // the random number stream of every thread
+    std::vector<Random> randoms;
+    // whether the tree being searched is shared between threads
+    bool shared;
+    // the game clock when searching by time, NULL when searching by iterations
+    TimeManager *timeman;
+    // the current position as far as the agent knows, updated by policy and acknowledge_move
+    Board board;
+    bool has_board;
+    // the background search on the opponent's time, and the flag that stops it
+    std::thread pondering;
+    std::atomic<bool> ponder_stop;
+    // how much searching was saved by stopping early
+    EarlyStopStats early_stop;
+    // for the telemetry: iterations run by the last search, and rollouts played in it
+    uint32_t searched;
+    std::atomic<uint64_t> rollouts_played;
+    // policy function that returns the best move given a position, with a telemetry record
+    // if enabled
     int policy(Position& pos);
-    // do one iteration of MCTS and update stats in place
-    void MCTS(TreeNode *node, Position& pos);
+    // the move to play, found by searching if need be
+    int choose(Position& pos);
+    // write the telemetry record of a move
+    void telemetry(Position& pos, int move, double seconds, uint64_t reused_nodes, int reused_visits);
+    // grow the trees from root for the given number of iterations or until stop is set, and
+    // return the number of iterations run
+    // if timed, the time manager decides when to set stop; if settle, each tree stops once
+    // its most visited root move is settled (with PARALLEL_TREE, stop is set once the one
+    // tree is)
+    uint32_t search(const Board& root, uint32_t iterations, bool timed, bool settle, std::atomic<bool>& stop);
+    // with a memory limit, turn the least visited subtrees back into leaves if the trees
+    // come near it
+    void recycle(void);
+    // start and stop the background search
+    void start_pondering(void);
+    void stop_pondering(void);
+    // sum the visits and rewards of the root children of all trees, or only of the given
+    // one, indexed by move + 1
+    void merge_roots(int chosen[65], int rewards[65], TreeNode *only = NULL);
+    // how many times more visits the best root move has than the runner-up
+    double lead(void);
+    // the visits of the most visited root move and of the runner-up, in all trees or only
+    // in the given one
+    void top_two(int& first, int& second, TreeNode *only = NULL);
+    // whether the runner-up root move of tree cannot catch up with the most visited one in
+    // the given number of iterations of it, by settle_fraction
+    bool settled(TreeNode *tree, uint32_t remaining);
+    // the move with the best outcome with perfect play, found by the solver
+    int solve(void);
+    // do one iteration of MCTS from root, update stats in place and return the rollout outcome
+    // new nodes are allocated from the given arena; table is the tree's transposition
+    // table, or NULL, and solver the thread's endgame solver, or NULL
+    int MCTS(TreeNode *root, Board& pos, NodeArena *arena, TranspositionTable *table, Solver *solver);
+    // the stages of an iteration: choose the index of the child of source to descend into,
+    // add the children of a leaf, roll out, and update the path with the outcome
+    int select(TreeNode *source, int sign);
+    bool expand(TreeNode *node, Board& pos, NodeArena *arena);
+    int simulate(Board& pos);
+    void backpropagate(PathStep *path, int length, int outcome);
     // do a rollout according to a particular default policy, and return game outcome
     Rollout rollout;
 };
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "bitboard.h"
+#include "position.h"
+#include "batch.h"
+
+using namespace std;
+
+
+// The SIMD kernels run the same Kogge-Stone fills as shift_moves in bitboard.h,
+// written once over a generic vector type V so that each lane holds one board.
+// V is either a Bitboard (one board) or a GCC/Clang vector of 4 or 8 Bitboards,
+// and every kernel is compiled for its instruction set with a target attribute.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86 1
+#else
+#define BATCH_X86 0
+#endif
+
+#define BATCH_INLINE inline __attribute__((always_inline))
+
+// the vector helpers below are always inlined into their kernels, so GCC's
+// warning about the ABI of returning wide vectors does not apply
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+typedef Bitboard Bitboard4 __attribute__((vector_size(4 * sizeof(Bitboard))));
+typedef Bitboard Bitboard8 __attribute__((vector_size(8 * sizeof(Bitboard))));
+
+
+// shift every lane by d squares: toward h8 if d > 0, toward a1 if d < 0
+template <typename V>
+static BATCH_INLINE V shift_lanes(const V& b, int d)
+{
+    return (d > 0) ? (b << d) : (b >> -d);
+}
+
+
+// moves in direction d for every lane, see shift_moves_dir in bitboard.h
+template <typename V>
+static BATCH_INLINE V moves_dir_lanes(const V& self, const V& enemy, const V& empty, int d, Bitboard m)
+{
+    V g = self;
+    V p = enemy & m;
+    g |= p & shift_lanes(g, d);
+    p &= shift_lanes(p, d);
+    g |= p & shift_lanes(g, 2 * d);
+    p &= shift_lanes(p, 2 * d);
+    g |= p & shift_lanes(g, 4 * d);
+    return shift_lanes(g & enemy, d) & m & empty;
+}
+
+
+// all legal moves for every lane, see shift_moves in bitboard.h
+template <typename V>
+static BATCH_INLINE V moves_lanes(const V& self, const V& enemy)
+{
+    V empty = ~(self | enemy);
+    return moves_dir_lanes(self, enemy, empty,  1, NOT_A_FILE) |
+           moves_dir_lanes(self, enemy, empty, -1, NOT_H_FILE) |
+           moves_dir_lanes(self, enemy, empty,  8, ~0ULL)      |
+           moves_dir_lanes(self, enemy, empty, -8, ~0ULL)      |
+           moves_dir_lanes(self, enemy, empty,  9, NOT_A_FILE) |
+           moves_dir_lanes(self, enemy, empty, -9, NOT_H_FILE) |
+           moves_dir_lanes(self, enemy, empty,  7, NOT_H_FILE) |
+           moves_dir_lanes(self, enemy, empty, -7, NOT_A_FILE);
+}
+
+
+// process the batch W boards at a time with vector type V, and the remainder one by one
+template <typename V, size_t W>
+static BATCH_INLINE void moves_batch(const Bitboard *player, const Bitboard *opponent, Bitboard *moves, size_t n)
+{
+    size_t i = 0;
+    for (; i + W <= n; i += W) {
+        V self, enemy, result;
+        memcpy(&self, player + i, sizeof(V));
+        memcpy(&enemy, opponent + i, sizeof(V));
+        result = moves_lanes(self, enemy);
+        memcpy(moves + i, &result, sizeof(V));
+    }
+    for (; i < n; i++)
+        moves[i] = shift_moves(player[i], opponent[i]);
+}
+
+
+// all ones in the lanes of b that are not zero, and zero in the others
+template <typename V>
+static BATCH_INLINE V nonzero_lanes(const V& b)
+{
+    return (V)(b != 0);
+}
+
+
+static BATCH_INLINE Bitboard nonzero_lanes(Bitboard b)
+{
+    return (b != 0) ? ~0ULL : 0;
+}
+
+
+// flips in direction d for every lane, see shift_flips_dir in bitboard.h
+template <typename V>
+static BATCH_INLINE V flips_dir_lanes(const V& self, const V& enemy, const V& placed, int d, Bitboard m)
+{
+    V g = placed;
+    V p = enemy & m;
+    g |= p & shift_lanes(g, d);
+    p &= shift_lanes(p, d);
+    g |= p & shift_lanes(g, 2 * d);
+    p &= shift_lanes(p, 2 * d);
+    g |= p & shift_lanes(g, 4 * d);
+    return nonzero_lanes(shift_lanes(g, d) & m & self) & g & enemy;
+}
+
+
+// all pieces flipped in every lane, see shift_flips in bitboard.h; a lane that places
+// no piece flips none
+template <typename V>
+static BATCH_INLINE V flips_lanes(const V& self, const V& enemy, const V& placed)
+{
+    return flips_dir_lanes(self, enemy, placed,  1, NOT_A_FILE) |
+           flips_dir_lanes(self, enemy, placed, -1, NOT_H_FILE) |
+           flips_dir_lanes(self, enemy, placed,  8, ~0ULL)      |
+           flips_dir_lanes(self, enemy, placed, -8, ~0ULL)      |
+           flips_dir_lanes(self, enemy, placed,  9, NOT_A_FILE) |
+           flips_dir_lanes(self, enemy, placed, -9, NOT_H_FILE) |
+           flips_dir_lanes(self, enemy, placed,  7, NOT_H_FILE) |
+           flips_dir_lanes(self, enemy, placed, -7, NOT_A_FILE);
+}
+
+
+// play n <= W games from pos (not over) in the lanes of V and return the sum of their outcomes
+// every lane plays a move or passes at every step, so all lanes have the same side to move;
+// a lane is over when it cannot move right after a pass, and sits out the remaining steps
+template <typename V, size_t W>
+static BATCH_INLINE int playouts_lanes(const Board& pos, int n, int (*pick)(Bitboard moves))
+{
+    Bitboard self[W], enemy[W], moves[W], placed[W];
+    bool playing[W], passed[W], ended[W];
+    int turn = pos.whose_turn();
+    for (size_t i = 0; i < W; i++) {
+        self[i] = pos.player;
+        enemy[i] = pos.opponent;
+        playing[i] = (i < (size_t)n);
+        ended[i] = false;
+        // whether the other side passed on the last turn
+        passed[i] = pos.state & (2 << (turn ^ 1));
+    }
+    V s, e, m, p;
+    memcpy(&s, self, sizeof(V));
+    memcpy(&e, enemy, sizeof(V));
+    int sum = 0;
+    while (n > 0) {
+        m = moves_lanes(s, e);
+        memcpy(moves, &m, sizeof(V));
+        bool finished = false;
+        for (size_t i = 0; i < W; i++) {
+            placed[i] = 0;
+            if (!playing[i]) continue;
+            if (moves[i] != 0) {
+                placed[i] = 1ULL << pick(moves[i]);
+                passed[i] = false;
+            } else if (!passed[i]) {
+                passed[i] = true;
+            } else {
+                // neither side can move: count the pieces below
+                playing[i] = false;
+                ended[i] = finished = true;
+                n--;
+            }
+        }
+        if (finished) {
+            memcpy(self, &s, sizeof(V));
+            memcpy(enemy, &e, sizeof(V));
+            for (size_t i = 0; i < W; i++) {
+                if (!ended[i]) continue;
+                int b = popcount(turn == BLACK ? self[i] : enemy[i]);
+                int w = popcount(turn == BLACK ? enemy[i] : self[i]);
+                sum += (b > w) - (b < w);
+                ended[i] = false;
+            }
+        }
+        // play the moves, passes included, and hand the turn over in every lane
+        memcpy(&p, placed, sizeof(V));
+        V f = flips_lanes(s, e, p);
+        V next = e ^ f;
+        e = s ^ f ^ p;
+        s = next;
+        turn ^= 1;
+    }
+    return sum;
+}
+
+
+// play k games, W at a time
+template <typename V, size_t W>
+static BATCH_INLINE int playouts_batch_lanes(const Board& pos, int k, int (*pick)(Bitboard moves))
+{
+    int sum = 0;
+    for (int i = 0; i < k; i += W)
+        sum += playouts_lanes<V, W>(pos, min(k - i, (int)W), pick);
+    return sum;
+}
+
+
+static void moves_batch_scalar(const Bitboard *player, const Bitboard *opponent, Bitboard *moves, size_t n)
+{
+    moves_batch<Bitboard, 1>(player, opponent, moves, n);
+}
+
+
+static int playouts_batch_scalar(const Board& pos, int k, int (*pick)(Bitboard moves))
+{
+    return playouts_batch_lanes<Bitboard, 1>(pos, k, pick);
+}
+
+
+#if BATCH_X86
+__attribute__((target("avx2")))
+static void moves_batch_avx2(const Bitboard *player, const Bitboard *opponent, Bitboard *moves, size_t n)
+{
+    moves_batch<Bitboard4, 4>(player, opponent, moves, n);
+}
+
+
+__attribute__((target("avx512f")))
+static void moves_batch_avx512(const Bitboard *player, const Bitboard *opponent, Bitboard *moves, size_t n)
+{
+    moves_batch<Bitboard8, 8>(player, opponent, moves, n);
+}
+
+
+__attribute__((target("avx2")))
+static int playouts_batch_avx2(const Board& pos, int k, int (*pick)(Bitboard moves))
+{
+    return playouts_batch_lanes<Bitboard4, 4>(pos, k, pick);
+}
+
+
+__attribute__((target("avx512f")))
+static int playouts_batch_avx512(const Board& pos, int k, int (*pick)(Bitboard moves))
+{
+    return playouts_batch_lanes<Bitboard8, 8>(pos, k, pick);
+}
+#endif
+
+
+// pick the widest kernel the CPU supports
+static BatchKernel widest_kernel(void)
+{
+    if (batch_kernel_supported(BATCH_AVX512)) return BATCH_AVX512;
+    if (batch_kernel_supported(BATCH_AVX2)) return BATCH_AVX2;
+    return BATCH_SCALAR;
+}
+
+static BatchKernel kernel = widest_kernel();
+
+
+// determine if the CPU we are running on supports the given kernel
+bool batch_kernel_supported(BatchKernel k)
+{
+#if BATCH_X86
+    __builtin_cpu_init();
+    switch (k) {
+        case BATCH_SCALAR: return true;
+        case BATCH_AVX2: return __builtin_cpu_supports("avx2");
+        case BATCH_AVX512: return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#else
+    return k == BATCH_SCALAR;
+#endif
+}
+
+
+// select the kernel used by generate_moves_batch
+bool set_batch_kernel(BatchKernel k)
+{
+    if (!batch_kernel_supported(k)) return false;
+    kernel = k;
+    return true;
+}
+
+
+// the kernel currently in use
+BatchKernel batch_kernel(void)
+{
+    return kernel;
+}
+
+
+// name of a kernel, for reporting
+const char *batch_kernel_name(BatchKernel k)
+{
+    switch (k) {
+        case BATCH_SCALAR: return "scalar";
+        case BATCH_AVX2: return "avx2";
+        case BATCH_AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+
+// generate the legal moves of n boards given as a structure of arrays
+void generate_moves_batch(const Bitboard *player, const Bitboard *opponent, Bitboard *moves, size_t n)
+{
+    switch (kernel) {
+#if BATCH_X86
+        case BATCH_AVX2: return moves_batch_avx2(player, opponent, moves, n);
+        case BATCH_AVX512: return moves_batch_avx512(player, opponent, moves, n);
+#endif
+        default: return moves_batch_scalar(player, opponent, moves, n);
+    }
+}
+
+
+// play k games from pos to the end and return the sum of their outcomes
+int playouts_batch(const Board& pos, int k, int (*pick)(Bitboard moves))
+{
+    if (pos.game_over()) return k * pos.outcome();
+    switch (kernel) {
+#if BATCH_X86
+        case BATCH_AVX2: return playouts_batch_avx2(pos, k, pick);
+        case BATCH_AVX512: return playouts_batch_avx512(pos, k, pick);
+#endif
+        default: return playouts_batch_scalar(pos, k, pick);
+    }
+}
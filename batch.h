@@ -0,0 +1,42 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include "bitboard.h"
+
+struct Board;
+
+
+// the kernels available for generating moves over a batch of boards
+// AVX2 handles 4 boards per instruction stream, AVX512 handles 8
+enum BatchKernel : int {
+    BATCH_SCALAR, BATCH_AVX2, BATCH_AVX512
+};
+
+// determine if the CPU we are running on supports the given kernel
+bool batch_kernel_supported(BatchKernel k);
+
+// select the kernel used by generate_moves_batch; returns false (and keeps
+// the current kernel) if the CPU does not support it
+// by default the widest supported kernel is selected at startup
+bool set_batch_kernel(BatchKernel k);
+
+// the kernel currently in use
+BatchKernel batch_kernel(void);
+
+// name of a kernel, for reporting
+const char *batch_kernel_name(BatchKernel k);
+
+// generate the legal moves of n boards given as a structure of arrays:
+// moves[i] receives the moves of the player owning player[i] against opponent[i]
+// the result is identical to shift_moves(player[i], opponent[i]) for every kernel
+void generate_moves_batch(const Bitboard *player, const Bitboard *opponent, Bitboard *moves, size_t n);
+
+// play k games from pos to the end and return the sum of their outcomes (1 if black wins,
+// 0 if it is a draw, -1 if white wins); the games advance in lockstep, one per lane of the
+// kernel, each lane with its own moves and flips, and lanes finish independently
+// pick chooses the square to play among a lane's legal moves
+int playouts_batch(const Board& pos, int k, int (*pick)(Bitboard moves));
+
+
+#endif
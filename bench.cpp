@@ -0,0 +1,474 @@
+/* The purpose of bench.cpp is to time the hot paths of the engine on a fixed
+ * corpus of positions sampled from the WTHOR database, so that runs can be
+ * compared between builds. Every benchmark is repeated several times and the
+ * results (ns/op, ops/sec and the variance of ns/op over the repeats) are
+ * written to stdout as JSON; progress goes to stderr.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <stdio.h>
+#include <fdeep/fdeep.hpp>
+#include "bitboard.h"
+#include "position.h"
+#include "batch.h"
+#include "agent.h"
+#include "rollout.h"
+#include "wthor.h"
+#include "solver.h"
+#include "prng.h"
+
+using namespace std;
+
+
+// results are accumulated here so that the compiler cannot drop the timed work
+static volatile uint64_t sink;
+
+// seed of the random numbers, fixed so that runs can be compared
+static const uint64_t SEED = 1;
+
+// each timed sample runs a benchmark for at least this long
+static const double MIN_SAMPLE_SECONDS = 0.02;
+
+// the CNN benchmarks use only this many corpus positions, since each forward pass is slow
+static const size_t CNN_POSITIONS = 32;
+
+// the lockstep rollout benchmarks play this many games from every position at once
+static const int LANE_ROLLOUTS[] = {4, 8, 16};
+
+// the MCTS benchmarks time this many iterations on trees grown from these many iterations
+static const uint32_t MCTS_ITERATIONS = 100;
+static const uint32_t MCTS_TREE_SIZES[] = {1000, 10000, 100000};
+
+// the scaling benchmarks time whole searches of this many iterations
+static const uint32_t SCALING_ITERATIONS = 20000;
+
+// the transposition benchmarks time whole searches of this many iterations, deep enough
+// for different move orders to meet
+static const uint32_t TRANSPOSITION_ITERATIONS = 100000;
+
+// the memory cap benchmark times searches of this many iterations under this memory limit,
+// which they would exceed several times over without it
+static const uint32_t CAPPED_ITERATIONS = 200000;
+static const size_t CAPPED_MEMORY = 4 << 20;
+
+// the solver benchmarks solve this many positions with each of these numbers of empty squares
+static const size_t SOLVE_POSITIONS = 16;
+static const int SOLVE_EMPTIES[] = {10, 12, 14, 16, 18};
+
+
+// timings of one benchmark: ns/op of every repeat
+struct Result {
+    string name;
+    uint64_t ops;
+    vector<double> samples;
+};
+
+
+// all games of the database
+static vector<Game> load_games(void)
+{
+    vector<Game> games;
+    for (int i = WTHOR_FIRST_YEAR; i <= WTHOR_LAST_YEAR; i++)
+        parse_wtb(games, wtb_file(i));
+    return games;
+}
+
+
+// sample up to n positions from the games at a fixed spread of games and plies
+// every position comes before the last move of its game, so none is game over; empty
+// games are skipped
+static vector<Board> load_corpus(const vector<Game>& games, size_t n)
+{
+    vector<Board> corpus;
+    if (games.empty()) return corpus;
+    for (size_t k = 0; k < n; k++) {
+        Game rectified;
+        rectify_game(games[k * games.size() / n], rectified);
+        if (rectified.empty()) continue;
+        size_t ply = (k * 7919) % rectified.size();
+        Board board = Position().board();
+        for (size_t m = 0; m < ply; m++)
+            board.make_move(rectified[m]);
+        corpus.push_back(board);
+    }
+    return corpus;
+}
+
+
+// up to n positions with the given number of empty squares and a legal move, from games
+// at a fixed spread
+static vector<Board> load_endgames(const vector<Game>& games, int empties, size_t n)
+{
+    vector<Board> endgames;
+    for (size_t k = 0; k < n && !games.empty(); k++) {
+        Game rectified;
+        rectify_game(games[(k * 7919) % games.size()], rectified);
+        Board board = Position().board();
+        for (size_t m = 0; m < rectified.size() && 64 - popcount(board.player | board.opponent) > empties; m++)
+            board.make_move(rectified[m]);
+        if (64 - popcount(board.player | board.opponent) == empties && board.generate_moves())
+            endgames.push_back(board);
+    }
+    return endgames;
+}
+
+
+// run pass (which performs ops operations) repeats times and record ns/op
+// passes are batched so that every sample lasts at least MIN_SAMPLE_SECONDS
+static Result measure(const string& name, uint64_t ops, int repeats, const function<void(void)>& pass)
+{
+    cerr << "running " << name << endl;
+    auto start = chrono::steady_clock::now();
+    pass(); // warm up
+    chrono::duration<double> once = chrono::steady_clock::now() - start;
+    int batch = (once.count() > 0) ? (int)ceil(MIN_SAMPLE_SECONDS / once.count()) : 1000;
+    if (batch < 1) batch = 1;
+    Result result = {name, ops * batch, vector<double>()};
+    for (int r = 0; r < repeats; r++) {
+        start = chrono::steady_clock::now();
+        for (int b = 0; b < batch; b++) pass();
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        result.samples.push_back(elapsed.count() / result.ops);
+    }
+    return result;
+}
+
+
+// write one result as a JSON object
+static void print_result(const Result& result, bool last)
+{
+    double mean = 0, variance = 0, min = result.samples[0];
+    for (double s : result.samples) {
+        mean += s;
+        if (s < min) min = s;
+    }
+    mean /= result.samples.size();
+    for (double s : result.samples)
+        variance += (s - mean) * (s - mean);
+    if (result.samples.size() > 1) variance /= result.samples.size() - 1;
+    printf("    {\"name\": \"%s\", \"ops\": %llu, \"repeats\": %d, \"ns_per_op\": %.3f, "
+           "\"ops_per_sec\": %.1f, \"variance_ns2\": %.6f, \"min_ns_per_op\": %.3f}%s\n",
+           result.name.c_str(), (unsigned long long)result.ops, (int)result.samples.size(),
+           mean, 1e9 / mean, variance, min, last ? "" : ",");
+}
+
+
+int main(int argc, char **argv) {
+    // command line format:
+    //   $ ./bench [-nPOSITIONS] [-rREPEATS] [-fFILTER] [-sTHREADS]
+    // -n: size of the corpus (default 1024), -r: timed repeats per benchmark (default 10)
+    // -f: only run the benchmarks whose name contains FILTER
+    // -s: also measure how MCTS iterations/sec scale with 1, 2, 4, ... up to THREADS threads
+    const char *usage = "usage: ./bench [-nPOSITIONS] [-rREPEATS] [-fFILTER] [-sTHREADS]\n";
+    size_t n = 1024;
+    int repeats = 10;
+    string filter = "";
+    int scaling = 0;
+    for (int i = 1; i < argc; i++) {
+        string f = argv[i];
+        if (f.rfind("-n", 0) == 0) n = stoul(f.substr(2));
+        else if (f.rfind("-r", 0) == 0) repeats = stoi(f.substr(2));
+        else if (f.rfind("-f", 0) == 0) filter = f.substr(2);
+        else if (f.rfind("-s", 0) == 0) scaling = stoi(f.substr(2));
+        else {
+            printf("%s", usage);
+            exit(1);
+        }
+    }
+    if (n < 1 || repeats < 1) {
+        printf("%s", usage);
+        exit(1);
+    }
+    // the rollouts of every run draw the same random numbers
+    seed_random(SEED);
+
+    vector<Game> games = load_games();
+    vector<Board> corpus = load_corpus(games, n);
+    if (corpus.empty()) {
+        printf("Error: no games found in ./database\n");
+        exit(1);
+    }
+    vector<Board> cnn_corpus(corpus.begin(), corpus.begin() + min(corpus.size(), CNN_POSITIONS));
+    vector<Result> results;
+    auto selected = [&](const string& name) { return name.find(filter) != string::npos; };
+
+    // Position::generate_moves and Position::make_move (with undo_move) under both generators
+    for (MoveGenerator g : {MOVEGEN_TABLE, MOVEGEN_SHIFT}) {
+        string suffix = (g == MOVEGEN_TABLE) ? "/table" : "/shift";
+        Position::set_move_generator(g);
+        vector<Position> positions;
+        vector<int> moves;
+        for (const Board& board : corpus) {
+            positions.push_back(Position(board));
+            Bitboard m = board.generate_moves();
+            moves.push_back(m ? bit_pos(m & (~m + 1)) : -1);
+        }
+        if (selected("position_generate_moves" + suffix))
+            results.push_back(measure("position_generate_moves" + suffix, positions.size(), repeats, [&]() {
+                uint64_t s = 0;
+                for (Position& pos : positions)
+                    s ^= pos.generate_moves((Color)pos.whose_turn());
+                sink = s;
+            }));
+        if (selected("position_make_undo_move" + suffix))
+            results.push_back(measure("position_make_undo_move" + suffix, positions.size(), repeats, [&]() {
+                Undo undo;
+                for (size_t i = 0; i < positions.size(); i++) {
+                    positions[i].make_move(moves[i], (Color)positions[i].whose_turn(), undo);
+                    positions[i].undo_move(undo);
+                }
+                sink = undo.flips;
+            }));
+    }
+    Position::set_move_generator(MOVEGEN_TABLE);
+
+    // generate_moves_batch with every kernel the CPU supports
+    vector<Bitboard> player, opponent, batch_moves(corpus.size());
+    for (const Board& board : corpus) {
+        player.push_back(board.player);
+        opponent.push_back(board.opponent);
+    }
+    BatchKernel kernel = batch_kernel();
+    for (BatchKernel k : {BATCH_SCALAR, BATCH_AVX2, BATCH_AVX512}) {
+        string name = string("generate_moves_batch/") + batch_kernel_name(k);
+        if (!set_batch_kernel(k) || !selected(name)) continue;
+        results.push_back(measure(name, corpus.size(), repeats, [&]() {
+            generate_moves_batch(player.data(), opponent.data(), batch_moves.data(), corpus.size());
+            sink = batch_moves[0];
+        }));
+    }
+    set_batch_kernel(kernel);
+
+    // one rollout from every corpus position
+    struct { const char *name; Rollout rollout; const vector<Board>& boards; } rollouts[] = {
+        {"rollout_unbiased", &RolloutUnbiased, corpus},
+        {"rollout_biased", &RolloutBiased, corpus},
+        {"rollout_cnn", &RolloutCNN, cnn_corpus}
+    };
+    for (auto& r : rollouts) {
+        if (!selected(r.name)) continue;
+        results.push_back(measure(r.name, r.boards.size(), repeats, [&]() {
+            int s = 0;
+            for (const Board& board : r.boards) {
+                Board pos = board;
+                s += r.rollout(pos);
+            }
+            sink = s;
+        }));
+    }
+
+    // k unbiased rollouts from every corpus position at once, in lockstep, with every kernel
+    // the CPU supports; timed per rollout, like the rollouts above
+    for (BatchKernel k : {BATCH_SCALAR, BATCH_AVX2, BATCH_AVX512}) {
+        if (!set_batch_kernel(k)) continue;
+        for (int lanes : LANE_ROLLOUTS) {
+            string name = string("rollout_lanes/") + batch_kernel_name(k) + "/" + to_string(lanes);
+            if (!selected(name)) continue;
+            results.push_back(measure(name, corpus.size() * lanes, repeats, [&]() {
+                int s = 0;
+                for (const Board& board : corpus)
+                    s += RolloutUnbiasedLanes(board, lanes);
+                sink = s;
+            }));
+        }
+    }
+    set_batch_kernel(kernel);
+
+    // MCTS iterations (with unbiased rollouts) on a tree already grown to a given size
+    // every repeat grows a fresh tree from the next corpus position with a legal move
+    // all MCTS benchmarks search without early stopping, so that every search runs its budget
+    vector<Board> mcts_corpus;
+    for (const Board& board : corpus)
+        if (board.generate_moves()) mcts_corpus.push_back(board);
+    for (uint32_t size : MCTS_TREE_SIZES) {
+        string name = "mcts_iteration/" + to_string(size);
+        if (!selected(name) || mcts_corpus.empty()) continue;
+        cerr << "running " << name << endl;
+        MCTSOptions options;
+        options.iterations = size;
+        options.settle_fraction = 0;
+        Result result = {name, MCTS_ITERATIONS, vector<double>()};
+        for (int r = 0; r < repeats; r++) {
+            Position pos(mcts_corpus[r % mcts_corpus.size()]);
+            MCTSComputerAgent agent((Color)pos.whose_turn(), options, &RolloutUnbiased);
+            agent.recommend_move(pos);
+            agent.set_iterations(MCTS_ITERATIONS);
+            auto start = chrono::steady_clock::now();
+            sink = agent.recommend_move(pos);
+            chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+            result.samples.push_back(elapsed.count() / MCTS_ITERATIONS);
+        }
+        results.push_back(result);
+    }
+
+    // MCTSComputerAgent::acknowledge_move right after a search that grew a tree of the given size
+    for (uint32_t size : MCTS_TREE_SIZES) {
+        string name = "mcts_acknowledge_move/" + to_string(size);
+        if (!selected(name) || mcts_corpus.empty()) continue;
+        cerr << "running " << name << endl;
+        MCTSOptions options;
+        options.iterations = size;
+        options.settle_fraction = 0;
+        Result result = {name, 1, vector<double>()};
+        for (int r = 0; r < repeats; r++) {
+            Position pos(mcts_corpus[r % mcts_corpus.size()]);
+            MCTSComputerAgent agent((Color)pos.whose_turn(), options, &RolloutUnbiased);
+            int move = agent.recommend_move(pos);
+            auto start = chrono::steady_clock::now();
+            agent.acknowledge_move(move);
+            chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+            result.samples.push_back(elapsed.count());
+        }
+        results.push_back(result);
+    }
+
+    // whole searches with unbiased rollouts on 1, 2, 4, ... threads, in both parallel modes
+    // ops/sec is MCTS iterations per second over all threads
+    for (int threads = 1; threads <= scaling; threads *= 2) {
+        for (MCTSParallel parallel : {PARALLEL_ROOT, PARALLEL_TREE}) {
+            string name = string("mcts_scaling/") + (parallel == PARALLEL_ROOT ? "root/" : "tree/") + to_string(threads);
+            if (!selected(name) || mcts_corpus.empty()) continue;
+            cerr << "running " << name << endl;
+            MCTSOptions options;
+            options.iterations = SCALING_ITERATIONS;
+            options.threads = threads;
+            options.parallel = parallel;
+            options.settle_fraction = 0;
+            Result result = {name, SCALING_ITERATIONS, vector<double>()};
+            for (int r = 0; r < repeats; r++) {
+                Position pos(mcts_corpus[r % mcts_corpus.size()]);
+                MCTSComputerAgent agent((Color)pos.whose_turn(), options, &RolloutUnbiased);
+                auto start = chrono::steady_clock::now();
+                sink = agent.recommend_move(pos);
+                chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+                result.samples.push_back(elapsed.count() / SCALING_ITERATIONS);
+            }
+            results.push_back(result);
+        }
+    }
+
+    // whole single-threaded searches with and without the transposition table, and how
+    // often and how much the table helped, summed over the repeats
+    TranspositionStats dag = {0, 0, 0, 0, 0};
+    for (bool transpositions : {false, true}) {
+        string name = string("mcts_transpositions/") + (transpositions ? "on" : "off");
+        if (!selected(name) || mcts_corpus.empty()) continue;
+        cerr << "running " << name << endl;
+        MCTSOptions options;
+        options.iterations = TRANSPOSITION_ITERATIONS;
+        options.transpositions = transpositions;
+        options.settle_fraction = 0;
+        Result result = {name, TRANSPOSITION_ITERATIONS, vector<double>()};
+        for (int r = 0; r < repeats; r++) {
+            Position pos(mcts_corpus[r % mcts_corpus.size()]);
+            MCTSComputerAgent agent((Color)pos.whose_turn(), options, &RolloutUnbiased);
+            auto start = chrono::steady_clock::now();
+            sink = agent.recommend_move(pos);
+            chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+            result.samples.push_back(elapsed.count() / TRANSPOSITION_ITERATIONS);
+            if (!transpositions) continue;
+            TranspositionStats stats = agent.transposition_stats();
+            dag.lookups += stats.lookups;
+            dag.hits += stats.hits;
+            dag.saved_bytes += stats.saved_bytes;
+            dag.table_bytes += stats.table_bytes;
+            dag.tree_bytes += stats.tree_bytes;
+        }
+        results.push_back(result);
+    }
+
+    // whole searches under a memory limit: the agent searches, the opponent answers with its
+    // first legal move, and the agent searches again in what is left of the tree
+    // also reports the most memory any of them used and reserved for nodes
+    size_t capped_used = 0, capped_reserved = 0;
+    if (selected("mcts_memory_cap") && !mcts_corpus.empty()) {
+        cerr << "running mcts_memory_cap" << endl;
+        MCTSOptions options;
+        options.iterations = CAPPED_ITERATIONS;
+        options.memory_limit = CAPPED_MEMORY;
+        options.settle_fraction = 0;
+        Result result = {"mcts_memory_cap", CAPPED_ITERATIONS, vector<double>()};
+        for (int r = 0; r < repeats; r++) {
+            Position pos(mcts_corpus[r % mcts_corpus.size()]);
+            Color side = (Color)pos.whose_turn();
+            MCTSComputerAgent agent(side, options, &RolloutUnbiased);
+            for (int turn = 0; turn < 4 && !pos.game_over(); turn++) {
+                Color c = (Color)pos.whose_turn();
+                Bitboard moves_bb = pos.generate_moves(c);
+                int m = moves_bb ? bit_pos(moves_bb & (~moves_bb + 1)) : -1;
+                if (c == side && moves_bb) {
+                    auto start = chrono::steady_clock::now();
+                    m = agent.recommend_move(pos);
+                    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+                    result.samples.push_back(elapsed.count() / CAPPED_ITERATIONS);
+                    capped_used = max(capped_used, agent.memory_used());
+                    capped_reserved = max(capped_reserved, (size_t)agent.transposition_stats().tree_bytes);
+                }
+                if (m < 0) pos.pass(c);
+                else pos.make_move(m, c);
+                agent.acknowledge_move(m);
+            }
+        }
+        results.push_back(result);
+    }
+
+    // exact endgame solves (win/loss/draw) by empty squares, each pass with a fresh table
+    for (int empties : SOLVE_EMPTIES) {
+        string name = "endgame_solve/" + to_string(empties);
+        if (!selected(name)) continue;
+        vector<Board> endgames = load_endgames(games, empties, SOLVE_POSITIONS);
+        if (endgames.empty()) continue;
+        results.push_back(measure(name, endgames.size(), repeats, [&]() {
+            Solver solver;
+            int s = 0;
+            for (const Board& board : endgames)
+                s += solver.outcome(board);
+            sink = s;
+        }));
+    }
+
+    // CNNComputerAgent::policy on every position of the CNN corpus
+    if (selected("cnn_policy")) {
+        CNNComputerAgent black(BLACK, Model), white(WHITE, Model);
+        vector<Position> positions;
+        for (const Board& board : cnn_corpus)
+            if (board.generate_moves()) positions.push_back(Position(board));
+        results.push_back(measure("cnn_policy", positions.size(), repeats, [&]() {
+            int s = 0;
+            for (Position& pos : positions)
+                s += (pos.whose_turn() == BLACK) ? black.recommend_move(pos) : white.recommend_move(pos);
+            sink = s;
+        }));
+    }
+
+    // report
+    printf("{\n");
+    printf("  \"compiler\": \"%s\",\n", __VERSION__);
+    printf("  \"bit_primitives\": \"%s\",\n", bit_primitives_name());
+    printf("  \"batch_kernel\": \"%s\",\n", batch_kernel_name(batch_kernel()));
+    printf("  \"seed\": %llu,\n", (unsigned long long)random_seed());
+    printf("  \"corpus\": {\"source\": \"WTHOR %d-%d\", \"positions\": %d, \"cnn_positions\": %d},\n",
+           WTHOR_FIRST_YEAR, WTHOR_LAST_YEAR, (int)corpus.size(), (int)cnn_corpus.size());
+    if (dag.lookups > 0)
+        printf("  \"transpositions\": {\"lookups\": %llu, \"hits\": %llu, \"hit_rate\": %.4f, "
+               "\"saved_bytes\": %llu, \"tree_bytes\": %llu, \"table_bytes\": %llu},\n",
+               (unsigned long long)dag.lookups, (unsigned long long)dag.hits, (double)dag.hits / dag.lookups,
+               (unsigned long long)dag.saved_bytes, (unsigned long long)dag.tree_bytes,
+               (unsigned long long)dag.table_bytes);
+    if (capped_reserved > 0)
+        printf("  \"memory_cap\": {\"limit_bytes\": %llu, \"used_bytes\": %llu, \"reserved_bytes\": %llu},\n",
+               (unsigned long long)CAPPED_MEMORY, (unsigned long long)capped_used,
+               (unsigned long long)capped_reserved);
+    printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+        print_result(results[i], i + 1 == results.size());
+    printf("  ]\n");
+    printf("}\n");
+
+    return 0;
+}
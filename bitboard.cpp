@@ -1,5 +1,7 @@
 #include <cstdint>
 #include <iostream>
+#include <string>
+#include <vector>
 #include "bitboard.h"
 
 using namespace std;
@@ -20,175 +22,155 @@ void print_board(Bitboard b) {
 }
 
 
-// a helper for computing move values
-static Move computeMoves(unsigned char self, unsigned char enemy, int length)
-{
-    unsigned char unoccupied = ~(self | enemy);
-    unsigned char captured;
-    unsigned char moves = 0;
-    captured = (self << 1) & enemy;
-    for (int i = 0; i < length - 3; i++)
-        captured |= (captured << 1) & enemy;
-    moves |= (captured << 1) & unoccupied;
-    captured = (self >> 1) & enemy;
-    for (int i = 0; i < length - 3; i++)
-        captured |= (captured >> 1) & enemy;
-    moves |= (captured >> 1) & unoccupied;
-    return moves;
+// The hardware versions of the bit primitives are compiled for the
+// instructions they need with target attributes, and are only ever
+// called after checking that the CPU supports those instructions.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITS_X86 1
+#include <immintrin.h>
+#else
+#define BITS_X86 0
+#endif
+
+#if BITS_X86
+__attribute__((target("popcnt")))
+static int popcount_popcnt(uint64_t i) {
+    return __builtin_popcountll(i);
 }
 
-// a helper for computing capture values
-static Capture computeCaptures(unsigned char self, unsigned char enemy, int length, int loc)
-{
-    unsigned char unoccupied = ~(self | enemy);
-    unsigned char piece_mask;
-    unsigned char left_captured, right_captured;
-    // try to place a piece of SELF at LOC, and then compute captures for it
-    piece_mask = 1 << loc;
-    if ((piece_mask & unoccupied) == 0) return 0;
-    // capture to the right, use <<
-    right_captured = (piece_mask << 1) & enemy;
-    for (int i = 0; i < length - 3; i++)
-        right_captured |= (right_captured << 1) & enemy;
-    if (((right_captured << 1) & self) == 0) right_captured = 0;
-    // capture to the left, use >>
-    left_captured = (piece_mask >> 1) & enemy;
-    for (int i = 0; i < length - 3; i++)
-        left_captured |= (left_captured >> 1) & enemy;
-    if (((left_captured >> 1) & self) == 0) left_captured = 0;
-    return right_captured | left_captured;
+
+__attribute__((target("bmi")))
+static int bit_pos_tzcnt(uint64_t i) {
+    return _tzcnt_u64(i);
 }
 
 
-Move Moves[256][256][2];
-Capture Captures[256][256][2][8];
+// deposit a single bit onto the set bits of v to select the one of rank r,
+// then convert its index to the portable function's convention
+__attribute__((target("bmi,bmi2,popcnt")))
+static unsigned int rth_setbit_position_pdep(uint64_t v, unsigned int r) {
+    uint64_t bit = _pdep_u64(1ULL << (__builtin_popcountll(v) - r), v);
+    return 64 - _tzcnt_u64(bit);
+}
+#endif
 
-// this function initializes all the move and capture cache values
-void computeMovesCaptures(void)
-{
-    unsigned int i, j, k;
-    for (i = 0; i < 256; i++) {
-        for (j = 0; j < 256; j++) {
-            Moves[i][j][BLACK] = computeMoves(i, j, 8);
-            Moves[i][j][WHITE] = computeMoves(j, i, 8);
-            for (k = 0; k < 8; k++) {
-                Captures[i][j][BLACK][k] = computeCaptures(i, j, 8, k);
-                Captures[i][j][WHITE][k] = computeCaptures(j, i, 8, k);
-            }
-        }
-    }
+
+int (*popcount_impl)(uint64_t i) = popcount_portable;
+int (*bit_pos_impl)(uint64_t i) = bit_pos_portable;
+unsigned int (*rth_setbit_position_impl)(uint64_t v, unsigned int r) = rth_setbit_position_portable;
+
+static const char *bits_name = "portable";
+
+
+// which hardware instructions the CPU supports
+static bool has_popcnt(void) {
+#if BITS_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("popcnt");
+#else
+    return false;
+#endif
+}
+
+static bool has_tzcnt(void) {
+#if BITS_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi");
+#else
+    return false;
+#endif
 }
 
-unsigned char CapturesOffsetUpright[64];
-unsigned char CapturesOffsetRotate90[64];
-unsigned char CapturesOffsetRotate45CW[64];
-unsigned char CapturesOffsetRotate45CCW[64];
-unsigned char CapturesLengthRotate45CW[64];
-unsigned char CapturesLengthRotate45CCW[64];
+// PDEP is microcoded and slower than the portable code on AMD before Zen 3
+static bool has_fast_pdep(void) {
+#if BITS_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt") &&
+           !__builtin_cpu_is("znver1") && !__builtin_cpu_is("znver2");
+#else
+    return false;
+#endif
+}
 
-unsigned char CapturesIndexUpright[64];
-unsigned char CapturesIndexRotate90[64];
-unsigned char CapturesIndexRotate45CW[64];
-unsigned char CapturesIndexRotate45CCW[64];
 
-// this function precomputes all the captures offsets/lengths
-void computeCapturesTables(void)
+// select the implementation of the bit primitives
+bool set_bit_primitives(BitPrimitives b)
 {
-    // upright board offset
-    for (int i = 0; i < 64; i++)
-        CapturesOffsetUpright[i] = (i >> 3) * 8;
-    // rotate90 board offset
-    for (int i = 0; i < 64; i++)
-        CapturesOffsetRotate90[i] = (7 - (i & 7)) * 8;
-    // rotate45 cw board offset and length
-    for (int i = 0; i < 64; i++) {
-        CapturesOffsetRotate45CW[i] = (((i >> 3) + (8 - (i & 7))) & 7) * 8;
-        if (i % 9 == 0) {
-            CapturesLengthRotate45CW[i] = 8;
-        } else if (i % 9 == 8 || i % 9 == 1) {
-            CapturesLengthRotate45CW[i] = 7;
-        } else if (i % 9 == 2) {
-            CapturesLengthRotate45CW[i] = (i >= 56) ? 1 : 6;
-        } else if (i % 9 == 3) {
-            CapturesLengthRotate45CW[i] = (i >= 48) ? 2 : 5;
-        } else if (i % 9 == 4) {
-            CapturesLengthRotate45CW[i] = (i >= 40) ? 3 : 4;
-        } else if (i % 9 == 5) {
-            CapturesLengthRotate45CW[i] = (i >= 32) ? 4 : 3;
-        } else if (i % 9 == 6) {
-            CapturesLengthRotate45CW[i] = (i >= 24) ? 5 : 2;
-        } else if (i % 9 == 7) {
-            CapturesLengthRotate45CW[i] = (i >= 16) ? 6 : 1;
-        } else cout << "bug!!" << endl;
-    }
-    for (int i = 0; i < 64; i++) {
-        switch(CapturesOffsetRotate45CW[i]) {
-            case 0: break;
-            case 8: if (i <= 7) CapturesOffsetRotate45CW[i] += 7; break;
-            case 16: if (i <= 15) CapturesOffsetRotate45CW[i] += 6; break;
-            case 24: if (i <= 23) CapturesOffsetRotate45CW[i] += 5; break;
-            case 32: if (i <= 31) CapturesOffsetRotate45CW[i] += 4; break;
-            case 40: if (i <= 39) CapturesOffsetRotate45CW[i] += 3; break;
-            case 48: if (i <= 47) CapturesOffsetRotate45CW[i] += 2; break;
-            case 56: if (i <= 55) CapturesOffsetRotate45CW[i] += 1; break;
-            default: cout << "bug!!" << endl;
-        }
-    }
-    // rotate45 ccw board offset and length
-    for (int i = 0; i < 64; i++) {
-        CapturesOffsetRotate45CCW[i] = (((i >> 3) + (1 + (i & 7))) & 7) * 8;
-        if (i % 7 == 0) {
-            CapturesLengthRotate45CCW[i] = (i == 0 || i == 63) ? 1 : 8;
-        } else if (i % 7 == 1) {
-            CapturesLengthRotate45CCW[i] = (i <= 8) ? 2 : 7;
-        } else if (i % 7 == 2) {
-            CapturesLengthRotate45CCW[i] = (i <= 16) ? 3 : 6;
-        } else if (i % 7 == 3) {
-            CapturesLengthRotate45CCW[i] = (i <= 24) ? 4 : 5;
-        } else if (i % 7 == 4) {
-            CapturesLengthRotate45CCW[i] = (i <= 32) ? 5 : 4;
-        } else if (i % 7 == 5) {
-            CapturesLengthRotate45CCW[i] = (i <= 40) ? 6 : 3;
-        } else if (i % 7 == 6) {
-            CapturesLengthRotate45CCW[i] = (i <= 48) ? 7 : 2;
-        } else cout << "bug!!!" << endl;
-    }
-    for (int i = 0; i < 64; i++) {
-        switch(CapturesOffsetRotate45CCW[i]) {
-            case 0: break;
-            case 8: if (i >= 15) CapturesOffsetRotate45CCW[i] += 1; break;
-            case 16: if (i >= 23) CapturesOffsetRotate45CCW[i] += 2; break;
-            case 24: if (i >= 31) CapturesOffsetRotate45CCW[i] += 3; break;
-            case 32: if (i >= 39) CapturesOffsetRotate45CCW[i] += 4; break;
-            case 40: if (i >= 47) CapturesOffsetRotate45CCW[i] += 5; break;
-            case 48: if (i >= 55) CapturesOffsetRotate45CCW[i] += 6; break;
-            case 56: if (i >= 63) CapturesOffsetRotate45CCW[i] += 7; break;
-            default: cout << "bug!!!" << endl;
-        }
+    popcount_impl = popcount_portable;
+    bit_pos_impl = bit_pos_portable;
+    rth_setbit_position_impl = rth_setbit_position_portable;
+    bool found = false;
+#if BITS_X86
+    if (b == BITS_HARDWARE) {
+        if (has_popcnt()) popcount_impl = popcount_popcnt;
+        if (has_tzcnt()) bit_pos_impl = bit_pos_tzcnt;
+        if (has_fast_pdep()) rth_setbit_position_impl = rth_setbit_position_pdep;
+        found = has_popcnt() || has_tzcnt() || has_fast_pdep();
     }
+#endif
+    // the primitives built to use an instruction use it whatever is selected
+    static string name;
+    name = "";
+    if (BITS_BUILTIN_POPCNT || popcount_impl != popcount_portable) name += " popcnt";
+    if (BITS_BUILTIN_TZCNT || bit_pos_impl != bit_pos_portable) name += " tzcnt";
+    if (BITS_BUILTIN_PDEP || rth_setbit_position_impl != rth_setbit_position_portable) name += " pdep";
+    bits_name = name.empty() ? "portable" : name.c_str() + 1;
+    return b == BITS_PORTABLE || found;
+}
 
-    // compute indices
-    for (int i = 0; i < 64; i++) {
-        CapturesIndexUpright[i] = i & 7;
-    }
+
+// describe the implementations currently in use
+const char *bit_primitives_name(void)
+{
+    return bits_name;
+}
+
+
+// compare every implementation the CPU supports against the portable one
+int check_bit_primitives(void)
+{
+    // edge cases: single bits, full and near-full words, then pseudo-random words
+    vector<uint64_t> values;
     for (int i = 0; i < 64; i++) {
-        CapturesIndexRotate90[i] = i >> 3;
+        values.push_back(1ULL << i);
+        values.push_back(~0ULL << i);
+        values.push_back(~0ULL >> i);
+        values.push_back(~(1ULL << i));
     }
-    for (int i = 0; i < 64; i++) {
-        if (CapturesOffsetRotate45CW[i] % 8 == 0) {
-            CapturesIndexRotate45CW[i] = (i - CapturesOffsetRotate45CW[i]) / 9;
-        } else {
-            CapturesIndexRotate45CW[i] = i / 9;
-        }
+    uint64_t x = 0x9e3779b97f4a7c15;
+    for (int i = 0; i < 100000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        values.push_back(x & (x >> (i & 31)));
     }
-    for (int i = 0; i < 64; i++) {
-        if (CapturesOffsetRotate45CCW[i] % 8 == 0) {
-            if (CapturesOffsetRotate45CCW[i] == 0) CapturesIndexRotate45CCW[i] = 8 - i / 7;
-            else CapturesIndexRotate45CCW[i] = (((CapturesOffsetRotate45CCW[i] + 56) % 64) >> 3) - i / 7;
-        } else {
-            if (i == 63) CapturesIndexRotate45CCW[i] = 0;
-            else CapturesIndexRotate45CCW[i] = 8 - i / 7;
+    int mismatches = 0;
+    for (uint64_t v : values) {
+        int count = popcount_portable(v);
+#if BITS_X86
+        if (has_popcnt() && popcount_popcnt(v) != count) mismatches++;
+#endif
+        // bit_pos is defined on words with a single set bit
+        uint64_t lsb = v & (~v + 1);
+        int index = bit_pos_portable(lsb);
+#if BITS_X86
+        if (has_tzcnt() && bit_pos_tzcnt(lsb) != index) mismatches++;
+#endif
+        if (popcount(v) != count || bit_pos(lsb) != index) mismatches++;
+        // rth_setbit_position is defined for ranks 1 to popcount
+        for (int r = 1; r <= count; r++) {
+            unsigned int s = rth_setbit_position_portable(v, r);
+#if BITS_X86
+            if (has_fast_pdep() && rth_setbit_position_pdep(v, r) != s) mismatches++;
+#endif
+            if (rth_setbit_position(v, r) != s) mismatches++;
         }
     }
-    return;
+    return mismatches;
 }
+
+
+// upgrade to the hardware instructions once at startup; until this has run,
+// the portable implementations above are used
+static bool bits_selected = set_bit_primitives(BITS_HARDWARE);
@@ -2,6 +2,9 @@
 #define BITBOARD_H
 
 #include <cstdint>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 
 typedef uint64_t Bitboard;
@@ -14,44 +17,49 @@ enum Color : int {
 };
 
 
+// The following lookup tables are computed at build time by tablegen.cpp,
+// which generates their definitions in tables.cpp as read-only data
+
 // given a row of N (N = 3, 4, ..., 8) squares and white pieces and black pieces
 // calculate the legal moves in that row and return the moves as set bits
 // for shorter rows < 8, we only need to truncate the leading bits to get correct moves
 // extern uint8_t Moves [BLACK_PIECES] [WHITE_PIECES] [COLOR]
-extern Move Moves[256][256][2];
+extern const Move Moves[256][256][2];
 
 // given a row of N (N = 3, 4, ..., 8) squares and white pieces and black pieces
 // calculate which pieces are flipped (captured) if a piece with given COLOR is PLACEed at a location
 // 0 if no piece is flipped (captured)
 // extern uint8_t Captures [BLACK_PIECES] [WHITE_PIECES] [COLOR] [PLACE]
-extern Capture Captures[256][256][2][8];
+extern const Capture Captures[256][256][2][8];
 
 // these tables map a move index (range 0-63) to a offset (range 0-63)
 // and in the case of 45 degrees rotation, a length
 // to help quickly obtain the "row" config for Captures lookup
-extern unsigned char CapturesOffsetUpright[64];
-extern unsigned char CapturesOffsetRotate90[64];
-extern unsigned char CapturesOffsetRotate45CW[64];
-extern unsigned char CapturesOffsetRotate45CCW[64];
-extern unsigned char CapturesLengthRotate45CW[64];
-extern unsigned char CapturesLengthRotate45CCW[64];
-extern unsigned char CapturesIndexUpright[64];
-extern unsigned char CapturesIndexRotate90[64];
-extern unsigned char CapturesIndexRotate45CW[64];
-extern unsigned char CapturesIndexRotate45CCW[64];
-
-// this function initializes all the move and capture cache values
-void computeMovesCaptures(void);
-
-// this function precomputes all the captures offsets/lengths/indices
-void computeCapturesTables(void);
+extern const unsigned char CapturesOffsetUpright[64];
+extern const unsigned char CapturesOffsetRotate90[64];
+extern const unsigned char CapturesOffsetRotate45CW[64];
+extern const unsigned char CapturesOffsetRotate45CCW[64];
+extern const unsigned char CapturesLengthRotate45CW[64];
+extern const unsigned char CapturesLengthRotate45CCW[64];
+extern const unsigned char CapturesIndexUpright[64];
+extern const unsigned char CapturesIndexRotate90[64];
+extern const unsigned char CapturesIndexRotate45CW[64];
+extern const unsigned char CapturesIndexRotate45CCW[64];
+
+// random keys for Zobrist hashing of positions
+// ZobristSquare [COLOR] [SQUARE] for a piece of COLOR on SQUARE
+// ZobristFlip [SQUARE] toggles a piece on SQUARE from one color to the other
+// ZobristState [STATE] for the side to move and passed flags, packed as in Board::state
+extern const uint64_t ZobristSquare[2][64];
+extern const uint64_t ZobristFlip[64];
+extern const uint64_t ZobristState[8];
 
 // print bitboards for debugging
 void print_board(Bitboard b);
 
 
 // an optimized way to count number of set bits in a 64-bit integer
-inline int popcount(uint64_t i) {
+inline int popcount_portable(uint64_t i) {
      i = i - ((i >> 1) & 0x5555555555555555);
      i = (i & 0x3333333333333333) + ((i >> 2) & 0x3333333333333333);
      return (((i + (i >> 4)) & 0x0F0F0F0F0F0F0F0F) * 0x0101010101010101) >> 56;
@@ -59,13 +67,14 @@ inline int popcount(uint64_t i) {
 
 
 // given a 64-bit integer with exactly 1 set bit, return the bit's position
-inline int bit_pos(uint64_t i) {
-  return popcount(i-1);
+inline int bit_pos_portable(uint64_t i) {
+  return popcount_portable(i-1);
 }
 
 
 // a function that returns the position of the set bit with given rank (r) in a uint64
-inline unsigned int rth_setbit_position(uint64_t v, unsigned int r) {
+// both are counted from the most significant bit: r = 1 selects the highest set bit, at position 64 - bit index
+inline unsigned int rth_setbit_position_portable(uint64_t v, unsigned int r) {
   unsigned int s;      // Output: Resulting position of bit with rank r [1-64]
   uint64_t a, b, c, d; // Intermediate temporaries for bit count.
   unsigned int t;      // Bit count temporary.
@@ -106,6 +115,82 @@ inline unsigned int rth_setbit_position(uint64_t v, unsigned int r) {
 }
 
 
+// The bit primitives used throughout the program dispatch at runtime
+// to either the portable functions above or to versions using the POPCNT,
+// TZCNT (BMI1) and PDEP (BMI2) instructions, so that one binary runs on
+// every CPU generation and uses the fast instructions where they exist.
+// The hardware versions are selected at startup when the CPU supports them.
+// A build for a CPU known to have an instruction (e.g. with -march=native)
+// uses it directly instead, and only dispatches the other primitives.
+
+#if defined(__POPCNT__)
+#define BITS_BUILTIN_POPCNT 1
+#else
+#define BITS_BUILTIN_POPCNT 0
+#endif
+#if defined(__BMI__)
+#define BITS_BUILTIN_TZCNT 1
+#else
+#define BITS_BUILTIN_TZCNT 0
+#endif
+// PDEP is microcoded and slower than the portable code on AMD before Zen 3
+#if defined(__BMI2__) && defined(__POPCNT__) && !defined(__znver1__) && !defined(__znver2__)
+#define BITS_BUILTIN_PDEP 1
+#else
+#define BITS_BUILTIN_PDEP 0
+#endif
+
+enum BitPrimitives : int {
+    BITS_PORTABLE, BITS_HARDWARE
+};
+
+// select the implementation of the bit primitives; returns false if the CPU supports
+// none of the hardware instructions, in which case the portable versions are used
+// the primitives built to use an instruction directly keep using it
+bool set_bit_primitives(BitPrimitives b);
+
+// describe the implementations currently in use, e.g. "popcnt tzcnt pdep"
+const char *bit_primitives_name(void);
+
+// compare every implementation the CPU supports against the portable one on
+// edge cases and pseudo-random values; returns the number of mismatches
+int check_bit_primitives(void);
+
+extern int (*popcount_impl)(uint64_t i);
+extern int (*bit_pos_impl)(uint64_t i);
+extern unsigned int (*rth_setbit_position_impl)(uint64_t v, unsigned int r);
+
+
+// count number of set bits in a 64-bit integer
+inline int popcount(uint64_t i) {
+#if BITS_BUILTIN_POPCNT
+    return __builtin_popcountll(i);
+#else
+    return popcount_impl(i);
+#endif
+}
+
+
+// given a 64-bit integer with exactly 1 set bit, return the bit's position
+inline int bit_pos(uint64_t i) {
+#if BITS_BUILTIN_TZCNT
+    return __builtin_ctzll(i);
+#else
+    return bit_pos_impl(i);
+#endif
+}
+
+
+// return the position of the set bit with given rank (r) in a uint64, see above
+inline unsigned int rth_setbit_position(uint64_t v, unsigned int r) {
+#if BITS_BUILTIN_PDEP
+    return 64 - __builtin_ctzll(_pdep_u64(1ULL << (__builtin_popcountll(v) - r), v));
+#else
+    return rth_setbit_position_impl(v, r);
+#endif
+}
+
+
 // The following functions use some bit tricks from
 // Chess programming Wiki to transform bitboard in 2D
 
@@ -165,6 +250,44 @@ inline Bitboard rotate90_ccw(Bitboard b) {
 }
 
 
+// the 8 symmetries of the board (the dihedral group D4)
+enum Symmetry : int {
+    SYM_IDENTITY, SYM_ROTATE90_CW, SYM_ROTATE180, SYM_ROTATE90_CCW,
+    SYM_FLIP_HORIZONTAL, SYM_FLIP_VERTICAL, SYM_FLIP_DIAG, SYM_FLIP_ANTIDIAG,
+    SYM_NUM = 8
+};
+
+
+// apply a symmetry to a bitboard
+inline Bitboard transform(Bitboard b, Symmetry s) {
+    switch (s) {
+        case SYM_ROTATE90_CW:     return rotate90_cw(b);
+        case SYM_ROTATE180:       return flip_vertical(flip_horizontal(b));
+        case SYM_ROTATE90_CCW:    return rotate90_ccw(b);
+        case SYM_FLIP_HORIZONTAL: return flip_horizontal(b);
+        case SYM_FLIP_VERTICAL:   return flip_vertical(b);
+        case SYM_FLIP_DIAG:       return flip_diag(b);
+        case SYM_FLIP_ANTIDIAG:   return flip_antidiag(b);
+        default:                  return b;
+    }
+}
+
+
+// the symmetry that undoes s
+inline Symmetry inverse(Symmetry s) {
+    if (s == SYM_ROTATE90_CW) return SYM_ROTATE90_CCW;
+    if (s == SYM_ROTATE90_CCW) return SYM_ROTATE90_CW;
+    return s;
+}
+
+
+// apply a symmetry to a square (range 0-63); negative moves (passes) are unchanged
+inline int transform_square(int square, Symmetry s) {
+    if (square < 0) return square;
+    return __builtin_ctzll(transform(1ULL << square, s));
+}
+
+
 inline Bitboard rotr(Bitboard n, unsigned char c) {
     return (n >> c) | (n << (64 - c));
 }
@@ -202,4 +325,74 @@ inline Bitboard pseudoRotate45_ccw_inverse(Bitboard b) {
 }
 
 
+// The following functions compute moves directly on upright bitboards
+// with directional shifts, without any lookup tables or rotated bitboards
+
+// masks that clear the file a wrapped-around shift would land on
+const Bitboard NOT_A_FILE = 0xfefefefefefefefe;
+const Bitboard NOT_H_FILE = 0x7f7f7f7f7f7f7f7f;
+
+
+// shift a bitboard by d squares: toward h8 if d > 0, toward a1 if d < 0
+inline Bitboard shift(Bitboard b, int d) {
+    return (d > 0) ? (b << d) : (b >> -d);
+}
+
+
+// Kogge-Stone fill of the enemy runs adjacent to self in direction d
+// m masks off squares that a shift by d could only reach by wrapping around
+// returns the empty squares that end such a run, i.e. moves in direction d
+inline Bitboard shift_moves_dir(Bitboard self, Bitboard enemy, Bitboard empty, int d, Bitboard m) {
+    Bitboard g = self;
+    Bitboard p = enemy & m;
+    g |= p & shift(g, d);
+    p &= shift(p, d);
+    g |= p & shift(g, 2 * d);
+    p &= shift(p, 2 * d);
+    g |= p & shift(g, 4 * d);
+    return shift(g & enemy, d) & m & empty;
+}
+
+
+// all legal moves for the player owning self against the player owning enemy
+inline Bitboard shift_moves(Bitboard self, Bitboard enemy) {
+    Bitboard empty = ~(self | enemy);
+    return shift_moves_dir(self, enemy, empty,  1, NOT_A_FILE) |
+           shift_moves_dir(self, enemy, empty, -1, NOT_H_FILE) |
+           shift_moves_dir(self, enemy, empty,  8, ~0ULL)      |
+           shift_moves_dir(self, enemy, empty, -8, ~0ULL)      |
+           shift_moves_dir(self, enemy, empty,  9, NOT_A_FILE) |
+           shift_moves_dir(self, enemy, empty, -9, NOT_H_FILE) |
+           shift_moves_dir(self, enemy, empty,  7, NOT_H_FILE) |
+           shift_moves_dir(self, enemy, empty, -7, NOT_A_FILE);
+}
+
+
+// Kogge-Stone fill of the enemy run starting next to the placed piece in direction d
+// the run is captured only if it is closed off by a piece of self
+inline Bitboard shift_flips_dir(Bitboard self, Bitboard enemy, Bitboard placed, int d, Bitboard m) {
+    Bitboard g = placed;
+    Bitboard p = enemy & m;
+    g |= p & shift(g, d);
+    p &= shift(p, d);
+    g |= p & shift(g, 2 * d);
+    p &= shift(p, 2 * d);
+    g |= p & shift(g, 4 * d);
+    return (shift(g, d) & m & self) ? (g & enemy) : 0;
+}
+
+
+// all enemy pieces flipped when self places a piece on the (empty) square placed
+inline Bitboard shift_flips(Bitboard self, Bitboard enemy, Bitboard placed) {
+    return shift_flips_dir(self, enemy, placed,  1, NOT_A_FILE) |
+           shift_flips_dir(self, enemy, placed, -1, NOT_H_FILE) |
+           shift_flips_dir(self, enemy, placed,  8, ~0ULL)      |
+           shift_flips_dir(self, enemy, placed, -8, ~0ULL)      |
+           shift_flips_dir(self, enemy, placed,  9, NOT_A_FILE) |
+           shift_flips_dir(self, enemy, placed, -9, NOT_H_FILE) |
+           shift_flips_dir(self, enemy, placed,  7, NOT_H_FILE) |
+           shift_flips_dir(self, enemy, placed, -7, NOT_A_FILE);
+}
+
+
 #endif
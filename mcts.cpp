@@ -1,197 +1,890 @@
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include <climits>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "agent.h"
 #include "position.h"
-#include "MERSENNE_TWISTER.h"
-MERSENNE_TWISTER twister_2(time(NULL));
+#include "tree.h"
+#include "timeman.h"
+#include "solver.h"
+#include "prng.h"
 
 using namespace std;
 
 
-// TreeNode is used to expand MC tree structure
-struct TreeNode {
-    vector<TreeNode*> children; // list of child positions
-    int move;                   // move leading from parent position to current position
-    int rewards;                // net number of wins
-    int base;                   // number of rollouts involving the parent
-    int chosen;                 // number of rollouts where this node is chosen by parent
-};
+// add v to a statistic of a node
+// only a tree shared between threads needs the (slower) atomic read-modify-write
+static inline void add(atomic<int>& stat, int v, bool shared)
+{
+    if (shared) stat.fetch_add(v, memory_order_relaxed);
+    else stat.store(stat.load(memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+
+// set up a node that has not been visited yet
+static void initNode(TreeNode *node, int move)
+{
+    node->children     = NULL;
+    node->key          = 0;
+    node->num_children = 0;
+    node->expanded     = LEAF;
+    node->move         = move;
+    node->proven       = UNPROVEN;
+    node->base         = 0;
+}
 
 
-// free all heap memory occupied by the tree
-static void dumpTree(TreeNode *root)
+// the default options, with the given number of iterations
+static MCTSOptions with_iterations(uint32_t iterations)
 {
-    for (auto child : root->children)
-        dumpTree(child);
-    delete root;
+    MCTSOptions options;
+    options.iterations = iterations;
+    return options;
 }
 
 
 // constructor
 MCTSComputerAgent::MCTSComputerAgent(Color c, uint32_t iterations, Rollout f) :
-    Agent(c), iterations(iterations), rollout(f)
+    MCTSComputerAgent(c, with_iterations(iterations), f) {}
+
+
+MCTSComputerAgent::MCTSComputerAgent(Color c, const MCTSOptions& options, Rollout f) :
+    Agent(c), options(options), shared(false), timeman(NULL), has_board(false), early_stop({0, 0, 0, 0}),
+    searched(0), rollouts_played(0), rollout(f)
 {
-    tree = NULL;
+    if (this->options.threads < 1) this->options.threads = 1;
+    if (options.lane_rollout == NULL || options.leaf_rollouts < 1) this->options.leaf_rollouts = 1;
+    if (options.game_time > 0) timeman = new TimeManager(options.game_time);
+    if (options.solve_empties > 0) {
+        for (int t = 0; t < this->options.threads; t++)
+            solvers.push_back(new Solver());
+    }
+    for (int t = 0; t < this->options.threads; t++)
+        randoms.push_back(random_stream());
 }
 
 
-// destructor
+// destructor: deleting the arenas frees every tree at once
 MCTSComputerAgent::~MCTSComputerAgent()
 {
-    if (tree != NULL) dumpTree(tree);
+    stop_pondering();
+    for (auto arena : arenas)
+        delete arena;
+    for (auto table : tables)
+        delete table;
+    for (auto solver : solvers)
+        delete solver;
+    delete timeman;
 }
 
 
-// acknowledge a move by preserving its branch and deleting all the others
+// acknowledge a move by preserving its branch and deleting all the others, in every tree
+// the chosen child takes the place of the root, so no memory is needed, and the rest of the
+// tree is handed to the arena, which reclaims it during later searches
+// with pondering, the search from before the move stops first, and after our own move
+// a new one starts from the opponent's position
+// the transposition tables may point into the discarded nodes, so they are cleared
 void MCTSComputerAgent::acknowledge_move(int move)
 {
-    if (tree == NULL) return;
-    TreeNode *newtree = NULL;
-    for (auto child : tree->children) {
-        if (child->move == move) newtree = child;
-        else dumpTree(child);
+    stop_pondering();
+    for (size_t t = 0; t < trees.size(); t++) {
+        TreeNode *tree = trees[t];
+        if (tree == NULL) continue;
+        TreeNode *block = tree->children;
+        int size = tree->num_children;
+        atomic<int> *chosen = block_chosen(block, size), *rewards = block_rewards(block, size);
+        bool found = false;
+        for (int i = 0; i < size; i++) {
+            TreeNode& child = block[i];
+            if (child.move != move) continue;
+            // the child lives in its parent's block, so move it and its statistics into the
+            // root's block of one
+            tree->children        = child.children;
+            tree->key             = child.key;
+            tree->num_children    = child.num_children;
+            tree->expanded        = child.expanded.load();
+            tree->move            = child.move;
+            tree->base            = child.base.load();
+            tree->proven          = child.proven.load();
+            block_chosen(tree, 1)[0]  = chosen[i].load();
+            block_rewards(tree, 1)[0] = rewards[i].load();
+            child.children        = NULL;
+            child.num_children    = 0;
+            found = true;
+        }
+        if (found) {
+            if (size > 0) arenas[t]->discard(block, size);
+        } else {
+            arenas[t]->discard(tree, 1);
+            trees[t] = NULL;
+        }
     }
-    delete tree;
-    tree = newtree;
+    for (auto table : tables)
+        table->new_generation();
+    // follow the game, and think on the opponent's time if it is their move
+    if (has_board) board.make_move(move);
+    start_pondering();
+}
+
+
+// the name of a square as othello prints it, e.g. "d3", or "pass"
+static string square_name(int move)
+{
+    if (move < 0) return "pass";
+    return string(1, 'a' + (move & 7)) + to_string((move >> 3) + 1);
 }
 
 
-// outputs the optimal move after performing MCTS
+// count the nodes of the trees, and find their greatest and their mean depth (the roots are
+// at depth 0); a LINKED node's children are counted where they belong
+static void measure_trees(const vector<TreeNode*>& trees, uint64_t& nodes, int& max_depth, double& mean_depth)
+{
+    nodes = 0;
+    max_depth = 0;
+    uint64_t depths = 0;
+    vector<pair<TreeNode*, int>> stack;
+    for (auto tree : trees)
+        if (tree != NULL) stack.push_back({tree, 0});
+    while (!stack.empty()) {
+        TreeNode *node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        nodes++;
+        depths += depth;
+        max_depth = max(max_depth, depth);
+        if (node->expanded.load(memory_order_acquire) != EXPANDED) continue;
+        for (TreeNode& child : *node)
+            stack.push_back({&child, depth + 1});
+    }
+    mean_depth = (nodes > 0) ? (double)depths / nodes : 0;
+}
+
+
+// outputs the optimal move after performing MCTS, and describes the search in the telemetry
+// stream if there is one
 int MCTSComputerAgent::policy(Position& pos)
 {
+    if (options.telemetry == NULL) return choose(pos);
+    // what is left of the trees from earlier moves (and from pondering) to start from
+    stop_pondering();
+    uint64_t reused_nodes;
+    int max_depth, reused_visits = 0;
+    double mean_depth;
+    measure_trees(trees, reused_nodes, max_depth, mean_depth);
+    for (auto tree : trees)
+        if (tree != NULL) reused_visits += block_chosen(tree, 1)[0];
+    rollouts_played = 0;
+    auto start = chrono::steady_clock::now();
+    int move = choose(pos);
+    chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+    telemetry(pos, move, seconds.count(), reused_nodes, reused_visits);
+    return move;
+}
+
+
+// write the telemetry record of a move as one line of JSON: the search (iterations run,
+// rollouts played and their rates), the trees (their nodes and memory, what was reused from
+// earlier moves, their depth) and the visits and value of every root move, the value being
+// the mean outcome from the side to move's point of view
+void MCTSComputerAgent::telemetry(Position& pos, int move, double seconds, uint64_t reused_nodes, int reused_visits)
+{
+    uint64_t nodes;
+    int max_depth;
+    double mean_depth;
+    measure_trees(trees, nodes, max_depth, mean_depth);
+    size_t reserved = 0;
+    for (auto arena : arenas)
+        reserved += arena->bytes();
+    uint64_t rollouts = rollouts_played;
+    ostream& out = *options.telemetry;
+    out << "{\"side\": \"" << (side == BLACK ? "black" : "white") << "\""
+        << ", \"empties\": " << 64 - popcount(pos.get_blackBB() | pos.get_whiteBB())
+        << ", \"move\": \"" << square_name(move) << "\""
+        << ", \"seconds\": " << seconds
+        << ", \"iterations\": " << searched
+        << ", \"iterations_per_sec\": " << ((seconds > 0) ? searched / seconds : 0)
+        << ", \"rollouts\": " << rollouts
+        << ", \"rollouts_per_sec\": " << ((seconds > 0) ? rollouts / seconds : 0)
+        << ", \"nodes\": " << nodes
+        << ", \"tree_bytes\": " << memory_used()
+        << ", \"reserved_bytes\": " << reserved
+        << ", \"reused_nodes\": " << reused_nodes
+        << ", \"reused_visits\": " << reused_visits
+        << ", \"max_depth\": " << max_depth
+        << ", \"mean_depth\": " << mean_depth
+        << ", \"root\": [";
+    int chosen[65], rewards[65];
+    merge_roots(chosen, rewards);
+    int sign = (side == BLACK) ? 1 : -1;
+    const char *separator = "";
+    for (int m = 0; m < 65; m++) {
+        if (chosen[m] == 0) continue;
+        out << separator << "{\"move\": \"" << square_name(m - 1) << "\", \"visits\": " << chosen[m]
+            << ", \"value\": " << (double)sign * rewards[m] / chosen[m] << "}";
+        separator = ", ";
+    }
+    out << "]}" << endl;
+}
+
+
+// the move to play: the only legal one, the solver's, or the best one found by searching
+int MCTSComputerAgent::choose(Position& pos)
+{
+    // the trees are ours again, and the position is known for sure
+    stop_pondering();
+    searched = 0;
+    board = pos.board();
+    has_board = true;
     Bitboard moves_bb = pos.generate_moves(side);
     if (!moves_bb) return -1;
-    // set up the root node
-    if (tree == NULL) {
-        tree           = new TreeNode();
-        tree->children = vector<TreeNode*>();
-        tree->move     = 0;
-        tree->rewards  = 0;
-        tree->base     = 0;
-        tree->chosen   = 0;
-    }
-    // perform search for targeted number of iterations
-    for (uint32_t i = 0; i < iterations; i++) {
-        Position pos_copy(pos); // make a write-able copy
-        MCTS(tree, pos_copy);
-    }
-    // pick the child that has been explored the most
+    if (options.settle_fraction > 0 && popcount(moves_bb) == 1) {
+        early_stop.single_moves++;
+        if (timeman == NULL) {
+            early_stop.budget += options.iterations;
+            early_stop.saved += options.iterations;
+        }
+        return bit_pos(moves_bb);
+    }
+    if (options.solve_empties > 0 && 64 - popcount(board.player | board.opponent) <= options.solve_empties)
+        return solve();
+    // perform search for targeted number of iterations or time
+    atomic<bool> stop(false);
+    if (timeman != NULL)
+        timeman->start(64 - popcount(pos.get_blackBB() | pos.get_whiteBB()));
+    bool timed = (timeman != NULL);
+    uint32_t run = search(board, timed ? UINT32_MAX : options.iterations, timed, options.settle_fraction > 0, stop);
+    searched = run;
+    if (timeman != NULL) {
+        timeman->stop();
+    } else {
+        early_stop.budget += options.iterations;
+        early_stop.saved += options.iterations - run;
+        if (run < options.iterations) early_stop.settled++;
+    }
+    int chosen[65], rewards[65];
+    merge_roots(chosen, rewards);
+    int sign = (side == BLACK) ? 1 : -1;
+    // play a move proven to win, and avoid the moves proven to lose unless all of them are
+    int proven[65];
+    for (int m = 0; m < 65; m++)
+        proven[m] = UNPROVEN;
+    for (auto tree : trees) {
+        if (tree == NULL || tree->expanded.load(memory_order_acquire) != EXPANDED) continue;
+        for (TreeNode& child : *tree)
+            if (child.proven.load(memory_order_relaxed) != UNPROVEN) proven[child.move + 1] = child.proven;
+    }
+    bool all_lost = true;
+    for (int m = 0; m < 65; m++) {
+        if (proven[m] == sign) return m - 1;
+        if (chosen[m] > 0 && proven[m] != -sign) all_lost = false;
+    }
+    // pick the move that has been explored the most, and on a tie the one with the
+    // better rewards for our side (rewards count from black's point of view)
+    int best = bit_pos(moves_bb & (~moves_bb + 1));
     int max = 0;
-    TreeNode *argmax;
-    for (auto child : tree->children) {
-        if (child->chosen > max) {
-            max = child->chosen;
-            argmax = child;
+    for (int m = 0; m < 65; m++) {
+        if (proven[m] == -sign && !all_lost) continue;
+        if (chosen[m] > max || (chosen[m] == max && max > 0 && sign * rewards[m] > sign * rewards[best + 1])) {
+            max = chosen[m];
+            best = m - 1;
         }
     }
-    int best = argmax->move;
     return best;
 }
 
 
-// perform MCTS starting from the given node for ONE iteration
-// update statistics in place
-void MCTSComputerAgent::MCTS(TreeNode *node, Position& pos)
+// grow the trees from root for the given number of iterations, split evenly over the
+// threads, or until stop is set (by the caller, or by thread 0 when timed and the time
+// manager says so), and return the number of iterations run
+// with settle, a thread stops once the most visited root move of its tree is settled for
+// the iterations it has left; with one tree per thread, that depends on nothing but the
+// thread's own tree, so a search by iterations stays reproducible from the seed
+// thread 0 is the calling thread; with PARALLEL_ROOT thread t searches tree t,
+// with PARALLEL_TREE all threads search tree 0; tree t allocates from arena t, which with
+// PARALLEL_TREE is shared by all threads
+uint32_t MCTSComputerAgent::search(const Board& root, uint32_t iterations, bool timed, bool settle, atomic<bool>& stop)
 {
-    // base case: node has no children
-    if (node->children.size() == 0) {
-        // if we are at a terminal position, tally rewards
-        if (pos.game_over()) {
-            node->rewards += pos.outcome();
-            node->chosen += 1;
-            return;
+    // set up the root node of every tree
+    shared = (options.parallel == PARALLEL_TREE && options.threads > 1);
+    trees.resize(shared ? 1 : options.threads, NULL);
+    while (arenas.size() < trees.size())
+        arenas.push_back(new NodeArena(options.memory_limit / trees.size(), shared));
+    recycle();
+    for (size_t t = 0; t < trees.size(); t++) {
+        if (trees[t] == NULL) {
+            trees[t] = arenas[t]->allocate(1);
+            initNode(trees[t], 0);
         }
-        // if non-terminal, expand by adding all possible children
-        Bitboard moves_bb = pos.generate_moves((Color)pos.whose_turn());
-        // no legal moves, has to pass
-        if (moves_bb == 0) {
-            TreeNode *new_node = new TreeNode();
-            new_node->children = vector<TreeNode*>();
-            new_node->move     = -1;
-            new_node->rewards  = 0;
-            new_node->base     = 1;
-            new_node->chosen   = 0;
-            node->children.push_back(new_node);
-        }
-        // have 1 or more legal moves, list them as new children nodes
-        else {
-            while (moves_bb != 0) {
-                Bitboard move = moves_bb & (~moves_bb + 1);
-                moves_bb &= (~move);
-                TreeNode *new_node = new TreeNode();
-                new_node->children = vector<TreeNode*>();
-                new_node->move     = bit_pos(move);
-                new_node->rewards  = 0;
-                new_node->base     = 1;
-                new_node->chosen   = 0;
-                node->children.push_back(new_node);
+    }
+    while (options.transpositions && tables.size() < trees.size())
+        tables.push_back(new TranspositionTable(options.table_size));
+    atomic<uint32_t> completed(0);
+    auto work = [this, &root, &stop, &completed, iterations, timed, settle](int t) {
+        uint32_t threads = options.threads;
+        uint32_t n = iterations / threads + ((uint32_t)t < iterations % threads);
+        TreeNode *tree = trees[shared ? 0 : t];
+        NodeArena *arena = arenas[shared ? 0 : t];
+        TranspositionTable *table = tables.empty() ? NULL : tables[shared ? 0 : t];
+        Solver *solver = solvers.empty() ? NULL : solvers[t];
+        // thread t draws from the agent's stream t, whichever thread runs it, so that a
+        // search by iterations with one tree per thread is reproducible from the seed
+        Random saved = thread_random();
+        thread_random() = randoms[t];
+        uint32_t done = 0;
+        while (done < n) {
+            Board pos_copy = root; // make a write-able copy
+            MCTS(tree, pos_copy, arena, table, solver);
+            done++;
+            // looking at the clock and the stop flag every 16 iterations is cheap enough
+            // (a proven root needs no more search either)
+            if ((done & 15) == 0) {
+                uint32_t all_done = completed.fetch_add(16, memory_order_relaxed) + 16;
+                if (timed && t == 0 && timeman->should_stop(lead())) stop = true;
+                if (settle && !shared && settled(tree, n - done)) break;
+                if (settle && shared && t == 0 && settled(tree, iterations - all_done)) stop = true;
+                if (stop.load(memory_order_relaxed)) break;
+                if (tree->proven.load(memory_order_relaxed) != UNPROVEN) break;
             }
         }
-        // randomly choose ONLY ONE child to rollout
-        // update the statistics in the process
-        int i = twister_2.randInt(node->children.size() - 1);
-        pos.make_move(node->children[i]->move, (Color)pos.whose_turn());
-        int outcome = rollout(pos);
-        node->children[i]->rewards += outcome;
-        node->children[i]->chosen += 1;
-        node->rewards += outcome;
-        node->chosen += 1;
-        return;
-    }
-    // recursive case: node has children already
-    for (auto child : node->children)
-        child->base += 1;
-    node->chosen += 1;
-    // choose to explore the child that maximizes/minimizes the UCB formula
-    // if current turn is BLACK, maximize
-    if (pos.whose_turn() == BLACK) {
-        TreeNode *argmax = NULL;
-        float max_UCB = std::numeric_limits<float>::lowest();
-        for (auto child : node->children) {
-            // check if the child has never been explored before
-            if (child->chosen == 0) {
-                argmax = child;
-                break;
-            }
-            // compute UCB for the child and update max as appropriate
-            float UCB = (float)child->rewards / child->chosen + sqrt(2 * log((float)child->base) / child->chosen);
-            if (UCB > max_UCB) {
-                max_UCB = UCB;
-                argmax = child;
+        completed.fetch_add(done & 15, memory_order_relaxed);
+        randoms[t] = thread_random();
+        thread_random() = saved;
+    };
+    vector<thread> workers;
+    for (int t = 1; t < options.threads; t++)
+        workers.push_back(thread(work, t));
+    work(0);
+    for (auto& worker : workers)
+        worker.join();
+    return completed;
+}
+
+
+// with a memory limit, once the trees take this fraction of it, recycle subtrees until they
+// take about this fraction
+static const double RECYCLE_AT = 0.75;
+static const double RECYCLE_TO = 0.5;
+
+
+// turn the least visited subtrees one and two moves deep back into leaves, keeping their
+// statistics, when the trees come near the memory limit
+// the size of a subtree is estimated by its visits, since an iteration expands at most one node
+void MCTSComputerAgent::recycle(void)
+{
+    if (options.memory_limit == 0) return;
+    double used = memory_used();
+    if (used < options.memory_limit * RECYCLE_AT) return;
+    double fraction = 1 - options.memory_limit * RECYCLE_TO / used;
+    for (size_t t = 0; t < trees.size(); t++) {
+        TreeNode *tree = trees[t];
+        if (tree == NULL || tree->expanded != EXPANDED) continue;
+        // the subtrees, each with its parent and visits
+        struct Subtree {
+            TreeNode *node;
+            TreeNode *parent;
+            int chosen;
+        };
+        vector<Subtree> subtrees;
+        for (int i = 0; i < tree->num_children; i++) {
+            TreeNode& child = tree->children[i];
+            if (child.expanded != EXPANDED) continue;
+            subtrees.push_back({&child, tree, tree->child_chosen()[i]});
+            for (int j = 0; j < child.num_children; j++)
+                if (child.children[j].expanded == EXPANDED)
+                    subtrees.push_back({&child.children[j], &child, child.child_chosen()[j]});
+        }
+        sort(subtrees.begin(), subtrees.end(), [](const Subtree& a, const Subtree& b) {
+            return a.chosen < b.chosen;
+        });
+        double goal = fraction * block_chosen(tree, 1)[0], recycled = 0;
+        for (auto& subtree : subtrees) {
+            if (recycled >= goal) break;
+            TreeNode *node = subtree.node;
+            // skip the subtrees of a child recycled already
+            if (subtree.parent->expanded != EXPANDED) continue;
+            arenas[t]->discard(node->children, node->num_children);
+            node->children = NULL;
+            node->num_children = 0;
+            node->expanded = LEAF;
+            recycled += subtree.chosen;
+        }
+    }
+    // the transposition tables may point into the recycled nodes
+    for (auto table : tables)
+        table->new_generation();
+}
+
+
+// start searching from the stored board on a background thread, if it is the opponent's turn
+void MCTSComputerAgent::start_pondering(void)
+{
+    if (!options.ponder || !has_board || board.game_over() || board.whose_turn() == side) return;
+    ponder_stop = false;
+    // searching by iterations, ponder for as many as a move gets; by time, until stopped
+    uint32_t iterations = (timeman != NULL) ? UINT32_MAX : options.iterations;
+    pondering = thread([this, iterations]() { search(board, iterations, false, false, ponder_stop); });
+}
+
+
+// stop the background search, if any, and wait for it to finish
+void MCTSComputerAgent::stop_pondering(void)
+{
+    if (!pondering.joinable()) return;
+    ponder_stop = true;
+    pondering.join();
+}
+
+
+// sum the visits and rewards of the root children of all trees, or only of the given one,
+// indexed by move + 1
+// safe to call while the threads are searching
+void MCTSComputerAgent::merge_roots(int chosen[65], int rewards[65], TreeNode *only)
+{
+    for (int m = 0; m < 65; m++)
+        chosen[m] = rewards[m] = 0;
+    for (auto tree : (only != NULL) ? vector<TreeNode*>{only} : trees) {
+        if (tree == NULL || tree->expanded.load(memory_order_acquire) != EXPANDED) continue;
+        for (int i = 0; i < tree->num_children; i++) {
+            int m = tree->children[i].move + 1;
+            chosen[m] += tree->child_chosen()[i].load(memory_order_relaxed);
+            rewards[m] += tree->child_rewards()[i].load(memory_order_relaxed);
+        }
+    }
+}
+
+
+// the visits of the most visited root move and of the runner-up, in all trees or only in
+// the given one
+void MCTSComputerAgent::top_two(int& first, int& second, TreeNode *only)
+{
+    int chosen[65], rewards[65];
+    merge_roots(chosen, rewards, only);
+    first = second = 0;
+    for (int m = 0; m < 65; m++) {
+        if (chosen[m] > first) {
+            second = first;
+            first = chosen[m];
+        } else if (chosen[m] > second) {
+            second = chosen[m];
+        }
+    }
+}
+
+
+// how many times more visits the best root move has than the runner-up
+double MCTSComputerAgent::lead(void)
+{
+    int first, second;
+    top_two(first, second);
+    if (second == 0) return (first == 0) ? 0 : numeric_limits<double>::max();
+    return (double)first / second;
+}
+
+
+// whether the runner-up root move of tree cannot catch up with the most visited one in the
+// given number of iterations of it, each adding leaf_rollouts visits to one root move, by
+// settle_fraction: with 1, the runner-up could not even draw level if every remaining
+// iteration went to it
+bool MCTSComputerAgent::settled(TreeNode *tree, uint32_t remaining)
+{
+    int first, second;
+    top_two(first, second, tree);
+    return first - second > options.settle_fraction * remaining * options.leaf_rollouts;
+}
+
+
+// statistics of the transposition tables since the agent was created
+TranspositionStats MCTSComputerAgent::transposition_stats(void)
+{
+    TranspositionStats stats = {0, 0, 0, 0, 0};
+    for (auto table : tables) {
+        stats.lookups += table->lookups;
+        stats.hits += table->hits;
+        stats.saved_bytes += table->saved_nodes * BLOCK_SLOT;
+        stats.table_bytes += table->bytes();
+    }
+    for (auto arena : arenas)
+        stats.tree_bytes += arena->bytes();
+    return stats;
+}
+
+
+// memory taken by the nodes of the trees, in bytes
+size_t MCTSComputerAgent::memory_used(void)
+{
+    size_t used = 0;
+    for (auto arena : arenas)
+        used += arena->used();
+    return used;
+}
+
+
+// the move with the best outcome with perfect play from the stored board, the first such
+// move in square order
+int MCTSComputerAgent::solve(void)
+{
+    int sign = (side == BLACK) ? 1 : -1;
+    int best = -1, best_outcome = -2;
+    for (Bitboard moves_bb = board.generate_moves(); moves_bb; moves_bb &= moves_bb - 1) {
+        int move = bit_pos(moves_bb & (~moves_bb + 1));
+        Board next = board;
+        next.make_move(move);
+        int outcome = sign * solvers[0]->outcome(next);
+        if (outcome > best_outcome) {
+            best_outcome = outcome;
+            best = move;
+        }
+        if (outcome == 1) break;
+    }
+    return best;
+}
+
+
+// a node is proven once one of the children it searches (those of source) is proven to win
+// for the side to move (sign is 1 for black, -1 for white), or once all of them are proven
+static void prove(TreeNode *node, TreeNode *source, int sign)
+{
+    // a win is enough, whatever the other children are
+    for (TreeNode& child : *source) {
+        if (child.proven.load(memory_order_relaxed) == sign) {
+            node->proven.store(sign, memory_order_relaxed);
+            return;
+        }
+    }
+    int best = -1;
+    for (TreeNode& child : *source) {
+        int proven = child.proven.load(memory_order_relaxed);
+        if (proven == UNPROVEN) return;
+        best = max(best, sign * proven);
+    }
+    node->proven.store(sign * best, memory_order_relaxed);
+}
+
+
+// perform ONE iteration of MCTS from the given root, update statistics in place and return
+// the outcome of the rollout (with leaf_rollouts games, their sum, each counting as a visit)
+// the iteration goes through four stages: select descends through the expanded nodes,
+// recording the path; expand adds the children of the node where the descent stops;
+// simulate rolls out from one of them; and backpropagate updates the path with the outcome
+// a node keeps its own statistics (in its parent's block, chosen and rewards below), but a
+// LINKED node searches the children of the node it is linked to, so that all move orders
+// leading to a position share what was learnt there
+int MCTSComputerAgent::MCTS(TreeNode *root, Board& pos, NodeArena *arena, TranspositionTable *table, Solver *solver)
+{
+    PathStep path[MAX_PATH];
+    int length = 0;
+    int outcome;
+    int visits = options.leaf_rollouts;
+    TreeNode *node = root;
+    atomic<int> *chosen = block_chosen(root, 1), *rewards = block_rewards(root, 1);
+    while (true) {
+        // a proven node is not searched again
+        int proven = node->proven.load(memory_order_relaxed);
+        if (proven != UNPROVEN) {
+            outcome = proven * visits;
+            add(*rewards, outcome, shared);
+            add(*chosen, visits, shared);
+            break;
+        }
+        TreeNode *source = node;
+        uint8_t state = node->expanded.load(memory_order_acquire);
+        if (state == LINKED) {
+            TreeNode *owner = table->find(node->key);
+            if (owner != NULL) {
+                source = owner;
+                state = EXPANDED;
             }
         }
-        // simulate downwards using the given child, and update stats afterwards
-        int old_rewards = argmax->rewards;
-        pos.make_move(argmax->move, BLACK);
-        MCTS(argmax, pos);
-        node->rewards += argmax->rewards - old_rewards;
-    }
-    // if current turn is WHITE, minimize
-    else if (pos.whose_turn() == WHITE) {
-        TreeNode *argmin = NULL;
-        float min_UCB = std::numeric_limits<float>::max();
-        for (auto child : node->children) {
-            // check if the child has never been explored before
-            if (child->chosen == 0) {
-                argmin = child;
+        // the node has children, or shares those of source: select one and descend
+        if (state == EXPANDED) {
+            int sign = (pos.whose_turn() == BLACK) ? 1 : -1;
+            add(*chosen, visits, shared);
+            int i = select(source, sign);
+            // every child is proven to lose
+            if (i < 0) {
+                node->proven.store(-sign, memory_order_relaxed);
+                outcome = -sign * visits;
+                add(*rewards, outcome, shared);
                 break;
             }
-            // compute UCB for the child and update min as appropriate
-            float UCB = (float)child->rewards / child->chosen - sqrt(2 * log((float)child->base) / child->chosen);
-            if (UCB < min_UCB) {
-                min_UCB = UCB;
-                argmin = child;
+            path[length++] = {node, rewards, source, i, sign};
+            node = &source->children[i];
+            chosen = source->child_chosen() + i;
+            rewards = source->child_rewards() + i;
+            pos.make_move(node->move);
+            continue;
+        }
+        // if we are at a terminal position, tally rewards
+        if (pos.game_over()) {
+            outcome = pos.outcome();
+            if (solver != NULL) node->proven.store(outcome, memory_order_relaxed);
+            outcome *= visits;
+            add(*rewards, outcome, shared);
+            add(*chosen, visits, shared);
+            break;
+        }
+        // if another thread is expanding this node, roll out from the node itself
+        // (a LINKED node whose node has left the table is expanded like a leaf)
+        if (state == EXPANDING || !node->expanded.compare_exchange_strong(state, EXPANDING, memory_order_acquire)) {
+            outcome = simulate(pos);
+            add(*rewards, outcome, shared);
+            add(*chosen, visits, shared);
+            break;
+        }
+        // near the end of the game, solve the position instead, and leave the node as it was
+        if (solver != NULL && 64 - popcount(pos.player | pos.opponent) <= options.solve_empties) {
+            outcome = solver->outcome(pos);
+            node->proven.store(outcome, memory_order_relaxed);
+            outcome *= visits;
+            node->expanded.store(state, memory_order_release);
+            add(*rewards, outcome, shared);
+            add(*chosen, visits, shared);
+            break;
+        }
+        // with a transposition table, link to the children of the same position if it has
+        // been expanded elsewhere, and descend into them instead
+        if (table != NULL && state == LEAF) {
+            node->key = pos.hash();
+            table->lookups.fetch_add(1, memory_order_relaxed);
+            TreeNode *owner = table->find(node->key);
+            if (owner != NULL) {
+                table->hits.fetch_add(1, memory_order_relaxed);
+                table->saved_nodes.fetch_add(owner->num_children, memory_order_relaxed);
+                node->expanded.store(LINKED, memory_order_release);
+                continue;
             }
         }
-        // simulate downwards using the given child, and update stats afterwards
-        int old_rewards = argmin->rewards;
-        pos.make_move(argmin->move, WHITE);
-        MCTS(argmin, pos);
-        node->rewards += argmin->rewards - old_rewards;
+        // out of memory: leave the node as it was, and roll out from it
+        if (!expand(node, pos, arena)) {
+            node->expanded.store(state, memory_order_release);
+            outcome = simulate(pos);
+            add(*rewards, outcome, shared);
+            add(*chosen, visits, shared);
+            break;
+        }
+        // publish the children to the other threads, and to the other move orders
+        node->expanded.store(EXPANDED, memory_order_release);
+        if (table != NULL)
+            table->insert(node, popcount(pos.player | pos.opponent));
+        // randomly choose ONLY ONE child to rollout
+        // update the statistics in the process
+        int i = thread_random().below(node->num_children);
+        pos.make_move(node->children[i].move);
+        outcome = simulate(pos);
+        add(node->child_rewards()[i], outcome, shared);
+        add(node->child_chosen()[i], visits, shared);
+        add(*rewards, outcome, shared);
+        add(*chosen, visits, shared);
+        break;
+    }
+    backpropagate(path, length, outcome);
+    return outcome;
+}
+
+
+// UCB values are computed for several children at a time, with the widest vectors the target
+// has; each Lanes type loads, computes and compares W floats at once
+#if defined(__AVX__)
+struct Lanes {
+    static const int W = 8;
+    typedef __m256 F;
+    static F load(const int *p) { return _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)p)); }
+    static F load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, F a) { _mm256_storeu_ps(p, a); }
+    static F set(float x) { return _mm256_set1_ps(x); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static int equal(F a, F b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+};
+#elif defined(__SSE2__)
+struct Lanes {
+    static const int W = 4;
+    typedef __m128 F;
+    static F load(const int *p) { return _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)p)); }
+    static F load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, F a) { _mm_storeu_ps(p, a); }
+    static F set(float x) { return _mm_set1_ps(x); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F sqrt(F a) { return _mm_sqrt_ps(a); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static int equal(F a, F b) { return _mm_movemask_ps(_mm_cmpeq_ps(a, b)); }
+};
+#else
+struct Lanes {
+    static const int W = 1;
+    typedef float F;
+    static F load(const int *p) { return (float)*p; }
+    static F load(const float *p) { return *p; }
+    static void store(float *p, F a) { *p = a; }
+    static F set(float x) { return x; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F div(F a, F b) { return a / b; }
+    static F sqrt(F a) { return std::sqrt(a); }
+    static F max(F a, F b) { return (a < b) ? b : a; }
+    static F min(F a, F b) { return (b < a) ? b : a; }
+    static int equal(F a, F b) { return a == b; }
+};
+#endif
+
+// statistics of a block copied out for selection, padded to a whole number of vectors
+enum { PADDED_BLOCK = NodeArena::MAX_BLOCK + Lanes::W };
+
+
+// the index of the child with the largest (sign 1) or smallest (sign -1) UCB value among the
+// n children with the given visits and rewards, the first of them on a tie, leaving out the
+// children in excluded (a bit per child); -1 if all of them are left out
+// every child must have been visited; log_base is 2 * log of the visits of the parent
+static int best_UCB(const int *chosen, const int *rewards, int n, float log_base, int sign, uint64_t excluded)
+{
+    typedef Lanes::F F;
+    float UCB[PADDED_BLOCK];
+    F L = Lanes::set(log_base);
+    for (int i = 0; i < n; i += Lanes::W) {
+        F c = Lanes::load(chosen + i);
+        F mean = Lanes::div(Lanes::load(rewards + i), c);
+        F bonus = Lanes::sqrt(Lanes::div(L, c));
+        Lanes::store(UCB + i, (sign == 1) ? Lanes::add(mean, bonus) : Lanes::sub(mean, bonus));
+    }
+    // the children left out, and the padding, can never be the best
+    float worst = (sign == 1) ? -numeric_limits<float>::infinity() : numeric_limits<float>::infinity();
+    for (uint64_t bb = excluded; bb; bb &= bb - 1)
+        UCB[bit_pos(bb & (~bb + 1))] = worst;
+    int padded = (n + Lanes::W - 1) / Lanes::W * Lanes::W;
+    for (int i = n; i < padded; i++)
+        UCB[i] = worst;
+    F best = Lanes::set(worst);
+    for (int i = 0; i < padded; i += Lanes::W)
+        best = (sign == 1) ? Lanes::max(best, Lanes::load(UCB + i)) : Lanes::min(best, Lanes::load(UCB + i));
+    float lanes[Lanes::W], b = worst;
+    Lanes::store(lanes, best);
+    for (float x : lanes)
+        b = (sign == 1) ? std::max(b, x) : std::min(b, x);
+    if (b == worst) return -1;
+    F B = Lanes::set(b);
+    for (int i = 0; i < padded; i += Lanes::W) {
+        int mask = Lanes::equal(Lanes::load(UCB + i), B);
+        if (mask) return i + bit_pos(mask & -mask);
+    }
+    return -1;
+}
+
+
+// count a visit to the children of source and choose the one to descend into, the one that
+// maximizes (black to move, sign 1) or minimizes (white, sign -1) the UCB formula
+// a child that has never been visited is chosen at once, in order, and so is a child proven
+// to win for the side to move; one proven to lose is never chosen
+// returns the index of the child, or -1 if all children are proven to lose
+// in a shared tree, the rollout counts as a loss for the side to move in the chosen child
+// until it finishes, so that other threads spread over other children instead of following it
+int MCTSComputerAgent::select(TreeNode *source, int sign)
+{
+    add(source->base, options.leaf_rollouts, shared);
+    int base = source->base.load(memory_order_relaxed);
+    int n = source->num_children;
+    atomic<int> *child_chosen = source->child_chosen(), *child_rewards = source->child_rewards();
+    int chosen[PADDED_BLOCK], rewards[PADDED_BLOCK];
+    uint64_t unvisited = 0;
+    for (int i = 0; i < n; i++) {
+        chosen[i] = child_chosen[i].load(memory_order_relaxed);
+        rewards[i] = child_rewards[i].load(memory_order_relaxed);
+        if (chosen[i] == 0) unvisited |= 1ULL << i;
+    }
+    // only the solver proves nodes
+    uint64_t won = 0, lost = 0;
+    if (options.solve_empties > 0) {
+        for (int i = 0; i < n; i++) {
+            int proven = source->children[i].proven.load(memory_order_relaxed);
+            if (proven == sign) won |= 1ULL << i;
+            else if (proven == -sign) lost |= 1ULL << i;
+        }
     }
+    int next;
+    uint64_t first = won | (unvisited & ~lost);
+    if (first) {
+        next = bit_pos(first & (~first + 1));
+    } else {
+        for (int i = n; i < n + Lanes::W; i++) {
+            chosen[i] = 1;
+            rewards[i] = 0;
+        }
+        // the exploration term depends on the parent's visits alone, so its log is taken once
+        next = best_UCB(chosen, rewards, n, 2 * log((float)base), sign, lost);
+    }
+    if (next >= 0 && shared) {
+        add(child_chosen[next], options.virtual_loss, shared);
+        add(child_rewards[next], -sign * options.virtual_loss, shared);
+    }
+    return next;
+}
+
 
-    return;
+// give a node that has no legal moves a single child that passes, and otherwise a child for
+// every legal move; returns false if there is no memory for them
+bool MCTSComputerAgent::expand(TreeNode *node, Board& pos, NodeArena *arena)
+{
+    Bitboard moves_bb = pos.generate_moves();
+    int size = (moves_bb == 0) ? 1 : popcount(moves_bb);
+    TreeNode *block = arena->allocate(size);
+    if (block == NULL) return false;
+    node->children = block;
+    node->num_children = size;
+    // no legal moves, has to pass
+    if (moves_bb == 0) {
+        initNode(&node->children[0], -1);
+    }
+    // have 1 or more legal moves, list them as new children nodes
+    else {
+        for (TreeNode& child : *node) {
+            Bitboard move = moves_bb & (~moves_bb + 1);
+            moves_bb &= (~move);
+            initNode(&child, bit_pos(move));
+        }
+    }
+    // the children count the rollouts that expand them
+    node->base = options.leaf_rollouts;
+    return true;
+}
+
+
+// play the position out with the rollout policy and return the outcome, or the sum of the
+// outcomes of leaf_rollouts games played at once
+int MCTSComputerAgent::simulate(Board& pos)
+{
+    if (options.telemetry != NULL) rollouts_played.fetch_add(options.leaf_rollouts, memory_order_relaxed);
+    if (options.leaf_rollouts > 1) return options.lane_rollout(pos, options.leaf_rollouts);
+    return rollout(pos);
+}
+
+
+// add the outcome to the rewards of every node on the path, from the bottom up, take back
+// the virtual losses, and prove the nodes whose chosen child has been proven
+void MCTSComputerAgent::backpropagate(PathStep *path, int length, int outcome)
+{
+    for (int i = length - 1; i >= 0; i--) {
+        PathStep& step = path[i];
+        if (shared) {
+            add(step.source->child_chosen()[step.child], -options.virtual_loss, shared);
+            add(step.source->child_rewards()[step.child], step.sign * options.virtual_loss, shared);
+        }
+        if (step.source->children[step.child].proven.load(memory_order_relaxed) != UNPROVEN)
+            prove(step.node, step.source, step.sign);
+        add(*step.rewards, outcome, shared);
+    }
 }
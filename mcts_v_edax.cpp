@@ -26,10 +26,6 @@ int main(int argc, char **argv) {
     int NUM_GAMES = stoi(argv[2]);
     int EDAX_DEPTH = stoi(argv[3]);
 
-    // precompute all the lookup tables
-    computeMovesCaptures();
-    computeCapturesTables();
-
     // play the desired number of games
     int black_wins = 0, white_wins = 0, draws = 0;
     for (int n = 0; n < NUM_GAMES; n++) {
@@ -2,123 +2,80 @@
 #include <string>
 #include <string.h>
 #include <chrono>
+#include <fstream>
 #include <fdeep/fdeep.hpp>
 #include "bitboard.h"
 #include "position.h"
 #include "agent.h"
-#include "MERSENNE_TWISTER.h"
-MERSENNE_TWISTER twister_3(time(NULL));
+#include "rollout.h"
+#include "prng.h"
 
 using namespace std;
 
 
-// load model for CNN
-fdeep::model Model = fdeep::load_model("move_predictor/trained_symmetric_fdeep.json");
-
-// define follout policies for unbiased, biased, and CNN-default
-
-// Unbiased default policy
-// pick uniformly randomly from all legal moves
-int RolloutUnbiased(Position& pos)
+// set the search budget of an MCTS agent from a command line flag:
+// a number of iterations per move, or a game clock in seconds if it ends with 's'
+static void set_budget(MCTSOptions& options, const string& budget)
 {
-    while (!pos.game_over()) {
-        Bitboard moves_bb = pos.generate_moves((Color)pos.whose_turn());
-        if (!moves_bb) {
-            pos.pass((Color)pos.whose_turn());
-            continue;
-        }
-        Bitboard pool = moves_bb;
-        // for performance reasons, we don't use Position.bb2vec to pick a random move
-        int r = 1 + twister_3.randInt(popcount(pool) - 1);
-        int m = 64 - rth_setbit_position(pool, r);
-        pos.make_move(m, (Color)pos.whose_turn());
-    }
-    return pos.outcome();
+    if (budget.empty()) return;
+    if (budget.back() == 's') options.game_time = stod(budget);
+    else options.iterations = stoi(budget);
 }
 
-// Biased default policy
-// if corner moves are available, then make one of the corner moves
-// otherwise if there are moves other than b2, b7, g2, g7 available, choose one of those
-// otherwise choose one of b2, b7, g2, g7
-int RolloutBiased(Position& pos)
-{
-    while (!pos.game_over()) {
-        Bitboard moves_bb = pos.generate_moves((Color)pos.whose_turn());
-        if (!moves_bb) {
-            pos.pass((Color)pos.whose_turn());
-            continue;
-        }
-        Bitboard pool = moves_bb;
-        // first prioritize corner squares
-        pool &= 0x8100000000000081;
-        if (pool == 0) pool = moves_bb;
-        // next eliminate b2, b7, g2, g7, if possible
-        pool &= 0xffbdffffffffbdff;
-        if (pool == 0) pool = moves_bb;
-        // for performance reasons, we don't use Position.bb2vec to pick a random move
-        int r = 1 + twister_3.randInt(popcount(pool) - 1);
-        int m = 64 - rth_setbit_position(pool, r);
-        pos.make_move(m, (Color)pos.whose_turn());
-    }
-    return pos.outcome();
-}
 
-// CNN default policy
-// use CNN classifier to predict moves each time
-int RolloutCNN(Position& pos)
+// add up how much searching an agent saved by stopping early, if it is an MCTS agent
+static void add_early_stop(EarlyStopStats& total, Agent *agent)
 {
-    while (!pos.game_over()) {
-        Bitboard moves_bb = pos.generate_moves((Color)pos.whose_turn());
-        if (!moves_bb) {
-            pos.pass((Color)pos.whose_turn());
-            continue;
-        }
-        // get board information and run model forward pass
-        Bitboard black_out = ((Color)pos.whose_turn() == BLACK) ? (pos.get_blackBB()) : (pos.get_whiteBB());
-        Bitboard white_out = ((Color)pos.whose_turn() == BLACK) ? (pos.get_whiteBB()) : (pos.get_blackBB());
-        fdeep::tensor T(fdeep::tensor_shape(8, 8, 2), 0);
-        for (int i = 0; i < 8; i++) {
-            for (int j = 0; j < 8; j++) {
-                int index = i * 8 + j; // rank of the bit
-                T.set(fdeep::tensor_pos(7-i, j, 0), (black_out >> index) & 0x1);
-                T.set(fdeep::tensor_pos(7-i, j, 1), (white_out >> index) & 0x1);
-            }
-        }
-        auto result = Model.predict({T}); // returns vector of fdeep::internal::tensor
-        auto outvec = result[0].to_vector();
+    MCTSComputerAgent *mcts = dynamic_cast<MCTSComputerAgent*>(agent);
+    if (mcts == NULL) return;
+    EarlyStopStats s = mcts->early_stop_stats();
+    total.budget += s.budget;
+    total.saved += s.saved;
+    total.settled += s.settled;
+    total.single_moves += s.single_moves;
+}
 
-        // cull the output vector by the legal moves
-        for (int i = 0; i < 27; i++) outvec[i] *= ((moves_bb >> i) & 0x1);
-        for (int i = 27; i < 33; i++) outvec[i] *= ((moves_bb >> (i + 2)) & 0x1);
-        for (int i = 33; i < 60; i++) outvec[i] *= ((moves_bb >> (i + 4)) & 0x1);
 
-        // output best move by finding index for argmax and remapping to board
-        float max = -1;
-        int move = -1;
-        for (int i = 0; i < outvec.size(); i++) {
-            if (outvec[i] > max) {
-                max = outvec[i];
-                move = i;
-            }
-        }
-        if (move >= 33) move += 4;
-        else if (move < 33 && move >= 27) move += 2;
-
-        pos.make_move(move, (Color)pos.whose_turn());
-    }
-    return pos.outcome();
+// print how much searching the agents of one color saved by stopping early
+static void print_early_stop(const string& color, const EarlyStopStats& s)
+{
+    if (s.budget == 0 && s.single_moves == 0) return;
+    cout << color << " iterations saved: " << s.saved << " of " << s.budget;
+    if (s.budget > 0) cout << " (" << 100.0 * s.saved / s.budget << "%)";
+    cout << ", " << s.settled << " searches stopped early, " << s.single_moves << " single moves" << endl;
 }
 
+
 int main(int argc, char **argv) {
     // error check command line format:
-    //   $ ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} (-t NUM)*
+    //   $ ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} [NUM] [-tTHREADS] [-proot | -ptree] [-ponder] [-dag] [-memMB] [-solveEMPTIES] [-lanesK] [-seedN] [-settleFRACTION] [-telemetryFILE]
     // arguments 1 & 2:
     //   -h (human) or -u (unbiased MCTS) or -b (biased MCTS) or -m (MCTS w/ CNN) or -c (CNN) or -r (random)
-    // argument 3: optional, only accepted if the two players are both machine
+    // argument NUM: optional, only accepted if the two players are both machine
     // for example: ./main -r -b50000 200
     // means let a random black agent and a biased MCTS agent with 50000 iterations play 200 games
-    if (argc != 3 && argc != 4) {
-        printf("usage: ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} NUM*\n");
+    // ITER may also be a game clock in seconds: ./main -u60s -b50000 lets the unbiased MCTS
+    // agent search by time, with 60 seconds for all of its moves
+    // argument -t: optional, number of threads each MCTS agent searches with (default 1)
+    // argument -p: optional, whether the threads grow one tree each (root, the default)
+    // or all grow one shared tree (tree)
+    // argument -ponder: optional, MCTS agents keep searching while the opponent thinks
+    // argument -dag: optional, MCTS agents share statistics between move orders that lead
+    // to the same position, through a transposition table
+    // argument -mem: optional, the most memory in megabytes the search tree nodes of each
+    // MCTS agent may take (not counting the tables of -dag and -solve)
+    // argument -solve: optional, MCTS agents solve positions with at most this many empty
+    // squares exactly instead of rolling them out
+    // argument -lanes: optional, unbiased and biased MCTS agents play this many rollouts from
+    // every leaf at once, in lockstep across SIMD lanes
+    // argument -seed: optional, seed of all random numbers, so that runs can be repeated
+    // (searches by iterations with -proot play the same way with the same seed)
+    // argument -settle: optional, MCTS agents stop a search once the runner-up move would need
+    // more than this fraction of the remaining iterations to catch up (default 1, 0 never)
+    // argument -telemetry: optional, MCTS agents append a JSON record of every search to
+    // this file, one per line
+    if (argc < 3 || argc > 14) {
+        printf("usage: ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} [NUM] [-tTHREADS] [-proot | -ptree] [-ponder] [-dag] [-memMB] [-solveEMPTIES] [-lanesK] [-seedN] [-settleFRACTION] [-telemetryFILE]\n");
         exit(1);
     }
 
@@ -127,25 +84,25 @@ int main(int argc, char **argv) {
     string f1 = argv[1];
     string f2 = argv[2];
     char p1, p2;
-    int n1 = 0, n2 = 0;
+    string n1, n2;
     if (f1.rfind("-h", 0) == 0) {
         p1 = 'h';
         hasHuman = true;
     } else if (f1.rfind("-u", 0) == 0) {
         p1 = 'u';
-        n1 = stoi(f1.substr(2));
+        n1 = f1.substr(2);
     } else if (f1.rfind("-b", 0) == 0) {
         p1 = 'b';
-        n1 = stoi(f1.substr(2));
+        n1 = f1.substr(2);
     } else if (f1.rfind("-m", 0) == 0) {
         p1 = 'm';
-        n1 = stoi(f1.substr(2));
+        n1 = f1.substr(2);
     } else if (f1.rfind("-c", 0) == 0) {
         p1 = 'c';
     } else if (f1.rfind("-r", 0) == 0) {
         p1 = 'r';
     } else {
-        printf("usage: ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} NUM*\n");
+        printf("usage: ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} [NUM] [-tTHREADS] [-proot | -ptree] [-ponder] [-dag] [-memMB] [-solveEMPTIES] [-lanesK] [-seedN] [-settleFRACTION] [-telemetryFILE]\n");
         exit(1);
     }
     if (f2.rfind("-h", 0) == 0) {
@@ -153,31 +110,81 @@ int main(int argc, char **argv) {
         hasHuman = true;
     } else if (f2.rfind("-u", 0) == 0) {
         p2 = 'u';
-        n2 = stoi(f2.substr(2));
+        n2 = f2.substr(2);
     } else if (f2.rfind("-b", 0) == 0) {
         p2 = 'b';
-        n2 = stoi(f2.substr(2));
+        n2 = f2.substr(2);
     } else if (f2.rfind("-m", 0) == 0) {
         p2 = 'm';
-        n2 = stoi(f2.substr(2));
+        n2 = f2.substr(2);
     } else if (f2.rfind("-c", 0) == 0) {
         p2 = 'c';
     } else if (f2.rfind("-r", 0) == 0) {
         p2 = 'r';
     } else {
-        printf("usage: ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} NUM*\n");
+        printf("usage: ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} [NUM] [-tTHREADS] [-proot | -ptree] [-ponder] [-dag] [-memMB] [-solveEMPTIES] [-lanesK] [-seedN] [-settleFRACTION] [-telemetryFILE]\n");
         exit(1);
     }
-    if (hasHuman && argc == 4) {
+    int competition = -1;
+    int threads = 1;
+    MCTSParallel parallel = PARALLEL_ROOT;
+    bool ponder = false;
+    bool transpositions = false;
+    size_t memory_limit = 0;
+    int solve_empties = 0;
+    int leaf_rollouts = 1;
+    double settle_fraction = 1.0;
+    string telemetry_file;
+    for (int i = 3; i < argc; i++) {
+        string f = argv[i];
+        if (f.rfind("-telemetry", 0) == 0) telemetry_file = f.substr(10);
+        else if (f.rfind("-t", 0) == 0) threads = stoi(f.substr(2));
+        else if (f == "-proot") parallel = PARALLEL_ROOT;
+        else if (f == "-ptree") parallel = PARALLEL_TREE;
+        else if (f == "-ponder") ponder = true;
+        else if (f == "-dag") transpositions = true;
+        else if (f.rfind("-mem", 0) == 0) memory_limit = stoul(f.substr(4)) << 20;
+        else if (f.rfind("-solve", 0) == 0) solve_empties = stoi(f.substr(6));
+        else if (f.rfind("-lanes", 0) == 0) leaf_rollouts = stoi(f.substr(6));
+        else if (f.rfind("-seed", 0) == 0) seed_random(stoull(f.substr(5)));
+        else if (f.rfind("-settle", 0) == 0) settle_fraction = stod(f.substr(7));
+        else if (!f.empty() && f.size() <= 9 && f.find_first_not_of("0123456789") == string::npos) competition = stoi(f);
+        else {
+            printf("usage: ./main [-h | [-uITER | -bITER | -mITER | -c | -r]]{2} [NUM] [-tTHREADS] [-proot | -ptree] [-ponder] [-dag] [-memMB] [-solveEMPTIES] [-lanesK] [-seedN] [-settleFRACTION] [-telemetryFILE]\n");
+            exit(1);
+        }
+    }
+    if (hasHuman && competition != -1) {
         printf("Error: cannot hold competition when human player is present\n");
         exit(1);
     }
-    int competition = -1;
-    if (argc == 4) competition = stoi(argv[3]);
-
-    // precompute all the lookup tables
-    computeMovesCaptures();
-    computeCapturesTables();
+    if (threads < 1) {
+        printf("Error: number of threads must be positive\n");
+        exit(1);
+    }
+    MCTSOptions options1, options2;
+    set_budget(options1, n1);
+    set_budget(options2, n2);
+    options1.threads = options2.threads = threads;
+    options1.parallel = options2.parallel = parallel;
+    options1.ponder = options2.ponder = ponder;
+    options1.transpositions = options2.transpositions = transpositions;
+    options1.memory_limit = options2.memory_limit = memory_limit;
+    options1.solve_empties = options2.solve_empties = solve_empties;
+    options1.leaf_rollouts = options2.leaf_rollouts = leaf_rollouts;
+    options1.settle_fraction = options2.settle_fraction = settle_fraction;
+    ofstream telemetry;
+    if (!telemetry_file.empty()) {
+        telemetry.open(telemetry_file, ios::app);
+        if (!telemetry) {
+            printf("Error: cannot open %s\n", telemetry_file.c_str());
+            exit(1);
+        }
+        options1.telemetry = options2.telemetry = &telemetry;
+    }
+    // the CNN policy has no lockstep version
+    options1.lane_rollout = (p1 == 'u') ? &RolloutUnbiasedLanes : (p1 == 'b') ? &RolloutBiasedLanes : NULL;
+    options2.lane_rollout = (p2 == 'u') ? &RolloutUnbiasedLanes : (p2 == 'b') ? &RolloutBiasedLanes : NULL;
 
     // initialize a new game of othello and the two agents for non-competition
     if (competition == -1) {
@@ -185,18 +192,18 @@ int main(int argc, char **argv) {
         Agent *black, *white;
         switch (p1) {
             case 'h': black = new HumanAgent(BLACK); break;
-            case 'u': black = new MCTSComputerAgent(BLACK, n1, &RolloutUnbiased); break;
-            case 'b': black = new MCTSComputerAgent(BLACK, n1, &RolloutBiased); break;
-            case 'm': black = new MCTSComputerAgent(BLACK, n1, &RolloutCNN); break;
+            case 'u': black = new MCTSComputerAgent(BLACK, options1, &RolloutUnbiased); break;
+            case 'b': black = new MCTSComputerAgent(BLACK, options1, &RolloutBiased); break;
+            case 'm': black = new MCTSComputerAgent(BLACK, options1, &RolloutCNN); break;
             case 'c': black = new CNNComputerAgent(BLACK, Model); break;
             case 'r': black = new RandomComputerAgent(BLACK); break;
             default: printf("impossible\n"); exit(1);
         }
         switch (p2) {
             case 'h': white = new HumanAgent(WHITE); break;
-            case 'u': white = new MCTSComputerAgent(WHITE, n2, &RolloutUnbiased); break;
-            case 'b': white = new MCTSComputerAgent(WHITE, n2, &RolloutBiased); break;
-            case 'm': white = new MCTSComputerAgent(WHITE, n2, &RolloutCNN); break;
+            case 'u': white = new MCTSComputerAgent(WHITE, options2, &RolloutUnbiased); break;
+            case 'b': white = new MCTSComputerAgent(WHITE, options2, &RolloutBiased); break;
+            case 'm': white = new MCTSComputerAgent(WHITE, options2, &RolloutCNN); break;
             case 'c': white = new CNNComputerAgent(WHITE, Model); break;
             case 'r': white = new RandomComputerAgent(WHITE); break;
             default: printf("impossible\n"); exit(1);
@@ -237,27 +244,33 @@ int main(int argc, char **argv) {
         if (outcome == 1) cout << "\033[31mBlack\033[0m won the game!" << endl;
         else if (outcome == -1) cout << "White won the game!" << endl;
         else cout << "Game is drawn." << endl;
+        EarlyStopStats black_stops = {0, 0, 0, 0}, white_stops = {0, 0, 0, 0};
+        add_early_stop(black_stops, black);
+        add_early_stop(white_stops, white);
+        print_early_stop("Black", black_stops);
+        print_early_stop("White", white_stops);
         delete black;
         delete white;
     }
     // for competition, silently play the number of games and display result at the end
     else {
         int black_wins = 0, white_wins = 0, draws = 0;
+        EarlyStopStats black_stops = {0, 0, 0, 0}, white_stops = {0, 0, 0, 0};
         for (int i = 0; i < competition; i++) {
             Position position = Position();
             Agent *black, *white;
             switch (p1) {
-                case 'u': black = new MCTSComputerAgent(BLACK, n1, &RolloutUnbiased); break;
-                case 'b': black = new MCTSComputerAgent(BLACK, n1, &RolloutBiased); break;
-                case 'm': black = new MCTSComputerAgent(BLACK, n1, &RolloutCNN); break;
+                case 'u': black = new MCTSComputerAgent(BLACK, options1, &RolloutUnbiased); break;
+                case 'b': black = new MCTSComputerAgent(BLACK, options1, &RolloutBiased); break;
+                case 'm': black = new MCTSComputerAgent(BLACK, options1, &RolloutCNN); break;
                 case 'c': black = new CNNComputerAgent(BLACK, Model); break;
                 case 'r': black = new RandomComputerAgent(BLACK); break;
                 default: printf("impossible\n"); exit(1);
             }
             switch (p2) {
-                case 'u': white = new MCTSComputerAgent(WHITE, n2, &RolloutUnbiased); break;
-                case 'b': white = new MCTSComputerAgent(WHITE, n2, &RolloutBiased); break;
-                case 'm': white = new MCTSComputerAgent(WHITE, n2, &RolloutCNN); break;
+                case 'u': white = new MCTSComputerAgent(WHITE, options2, &RolloutUnbiased); break;
+                case 'b': white = new MCTSComputerAgent(WHITE, options2, &RolloutBiased); break;
+                case 'm': white = new MCTSComputerAgent(WHITE, options2, &RolloutCNN); break;
                 case 'c': white = new CNNComputerAgent(WHITE, Model); break;
                 case 'r': white = new RandomComputerAgent(WHITE); break;
                 default: printf("impossible\n"); exit(1);
@@ -284,6 +297,8 @@ int main(int argc, char **argv) {
                 draws++;
                 cout << "Game " << i + 1 << ": draw" << endl;
             }
+            add_early_stop(black_stops, black);
+            add_early_stop(white_stops, white);
             delete black;
             delete white;
         }
@@ -292,6 +307,8 @@ int main(int argc, char **argv) {
         cout << "Black wins: " << black_wins << endl;
         cout << "White wins: " << white_wins << endl;
         cout << "Draws: " << draws << endl;
+        print_early_stop("Black", black_stops);
+        print_early_stop("White", white_stops);
     }
 
     return 0;
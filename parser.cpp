@@ -9,13 +9,11 @@
 #include <vector>
 #include "bitboard.h"
 #include "position.h"
+#include "wthor.h"
 
 using namespace std;
 
 
-// A "Game" object is defined as a sequence of moves
-typedef vector<int> Game;
-
 // A SAPair is a state action pair (the position and corresponding move from WTHOR)
 typedef struct {
     Bitboard black;
@@ -24,41 +22,6 @@ typedef struct {
 } SAPair;
 
 
-// read a .wtb file and add all the games in there
-void parse_wtb(vector<Game> &games, string file) {
-    ifstream input(file, ifstream::binary);
-    
-    // skip the first 16 bytes of the file
-    char c;
-    for (int i = 0; i < 16; i++)
-        input.get(c);
-
-    // read 68 bytes at a time and ignore the first 8 bytes
-    while (true) {
-        Game new_game;
-        for (int i = 0; i < 8; i++)
-            if (!input.get(c)) {
-                input.close();
-                return;
-            }
-        for (int i = 0; i < 60; i++) {
-            input.get(c);
-            if (c == 0) {
-                new_game.push_back(-1);
-                continue;
-            }
-            int row, col;
-            col = (int)c % 10 - 1;
-            row = 8 - (int)c / 10;
-            new_game.push_back(row * 8 + col);
-        }
-        games.push_back(new_game);
-    }
-
-    input.close();
-}
-
-
 // for each (state, action) pair, we encode it into 17 bytes
 // 8 bytes for blackBB, 8 bytes for whiteBB, and 1 byte for the move
 // For the BB's: 0xff00000000000000 is written into (0, 0, 0, 0, 0, 0, 0, 255) (order is REVERSED!!)
@@ -81,16 +44,12 @@ void encode_datum(SAPair &sa, ofstream &outfile) {
 
 
 int main(void) {
-    // precompute all the lookup tables
-    computeMovesCaptures();
-    computeCapturesTables();
-
     // read all games from the wtb files
     vector<Game> games;
-    for (int i = 1977; i <= 2020; i++) {
-        string filename = "./database/WTH_" + to_string(i) + ".wtb";
+    for (int i = WTHOR_FIRST_YEAR; i <= WTHOR_LAST_YEAR; i++) {
+        string filename = wtb_file(i);
         cout << "Reading " << filename << endl;
-        parse_wtb(games, "./database/WTH_" + to_string(i) + ".wtb");
+        parse_wtb(games, filename);
     }
     cout << "Total number of games read: " << games.size() << endl;
 
@@ -105,36 +64,8 @@ int main(void) {
     cout << "Rectifying games..." << endl;
     for (auto game : games) {
         Game new_game_rectified;
-        Position position = Position();
-        int outcome = 2; // 2: undefined
-        for (int m = 0; m < game.size(); m++) {
-            int move = game[m];
-            Color side = (Color)position.whose_turn();
-            Bitboard moves_bb = position.generate_moves(side);
-            if (moves_bb == 0) {
-                position.make_move(-1, side);
-                m--; // current game[m] belongs to the other player
-                new_game_rectified.push_back(-1);
-            } else {
-                position.make_move(move, side);
-                new_game_rectified.push_back(move);
-            }
-            if (position.game_over()) {
-                outcome = position.outcome();
-                winners.push_back(outcome);
-                break;
-            }
-        }
-        // there are special cases where the game is not over (presumably because one side resigned)
-        if (!position.game_over()) {
-            position.make_move(-1, (Color)position.whose_turn());
-            outcome = position.outcome();
-            winners.push_back(outcome);
-        }
-        // remove all the trailing passes in new_game_rectified
-        while (new_game_rectified.back() == -1) {
-            new_game_rectified.pop_back();
-        }
+        int outcome = rectify_game(game, new_game_rectified);
+        winners.push_back(outcome);
         games_rectified.push_back(new_game_rectified);
         if (outcome == 1) black_wins += 1;
         else if (outcome == -1) white_wins += 1;
@@ -0,0 +1,218 @@
+/* The purpose of perft.cpp is to verify and measure the move generator in
+ * isolation. It counts the leaf nodes of the game tree to a given depth,
+ * splits the subtrees across threads, reports the node rate and checks the
+ * counts from the initial position against the published reference values.
+ * A pass is a move like any other (Position::make_move(-1, ...)), and a
+ * position where the game is over counts as a leaf at any depth.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include "bitboard.h"
+#include "position.h"
+
+using namespace std;
+
+
+// leaf counts from the initial position for depths 0, 1, 2, ... (OEIS A124004)
+static const uint64_t StartCounts[] = {
+    1ULL, 4ULL, 12ULL, 56ULL, 244ULL, 1396ULL, 8200ULL, 55092ULL, 390216ULL, 3005288ULL,
+    24571284ULL, 212258800ULL, 1939886636ULL, 18429641748ULL, 184042084512ULL
+};
+static const int StartCountsNum = sizeof(StartCounts) / sizeof(StartCounts[0]);
+
+
+// parse a position in the format of Position::serialize
+// the passed flags are not part of that format and start out false
+static bool parse_position(const string& s, Board& board)
+{
+    if (s.length() != 65) return false;
+    Bitboard black = 0, white = 0;
+    int k = 0;
+    for (int i = 56; i >= 0; i -= 8) {
+        for (int j = i; j < i+8; j++, k++) {
+            if (s[k] == 'b') black |= 1ULL << j;
+            else if (s[k] == 'w') white |= 1ULL << j;
+            else if (s[k] != '.') return false;
+        }
+    }
+    if (s[64] != 'b' && s[64] != 'w') return false;
+    board.state = (s[64] == 'b') ? BLACK : WHITE;
+    board.player = (s[64] == 'b') ? black : white;
+    board.opponent = (s[64] == 'b') ? white : black;
+    return true;
+}
+
+
+// count the leaves below a Position, walking the tree with make/undo move
+static uint64_t perft_position(Position& pos, int depth)
+{
+    if (depth == 0 || pos.game_over()) return 1;
+    Color c = (Color)pos.whose_turn();
+    Bitboard moves = pos.generate_moves(c);
+    // at the last ply every move (or the pass) is one leaf
+    if (depth == 1) return moves ? popcount(moves) : 1;
+    Undo undo;
+    if (!moves) {
+        pos.make_move(-1, c, undo);
+        uint64_t nodes = perft_position(pos, depth - 1);
+        pos.undo_move(undo);
+        return nodes;
+    }
+    uint64_t nodes = 0;
+    for (; moves; moves &= moves - 1) {
+        pos.make_move(bit_pos(moves & (~moves + 1)), c, undo);
+        nodes += perft_position(pos, depth - 1);
+        pos.undo_move(undo);
+    }
+    return nodes;
+}
+
+
+// count the leaves below a compact Board, copying it for every child
+static uint64_t perft_board(const Board& board, int depth)
+{
+    if (depth == 0 || board.game_over()) return 1;
+    Bitboard moves = board.generate_moves();
+    if (depth == 1) return moves ? popcount(moves) : 1;
+    if (!moves) {
+        Board child = board;
+        child.pass();
+        return perft_board(child, depth - 1);
+    }
+    uint64_t nodes = 0;
+    for (; moves; moves &= moves - 1) {
+        Board child = board;
+        child.make_move(bit_pos(moves & (~moves + 1)));
+        nodes += perft_board(child, depth - 1);
+    }
+    return nodes;
+}
+
+
+// collect the positions at the given ply below board (or where the game ends
+// before it) as independent units of work for the threads
+static void split(const Board& board, int ply, vector<Board>& work)
+{
+    if (ply == 0 || board.game_over()) {
+        work.push_back(board);
+        return;
+    }
+    Bitboard moves = board.generate_moves();
+    if (!moves) {
+        Board child = board;
+        child.pass();
+        return split(child, ply - 1, work);
+    }
+    for (; moves; moves &= moves - 1) {
+        Board child = board;
+        child.make_move(bit_pos(moves & (~moves + 1)));
+        split(child, ply - 1, work);
+    }
+}
+
+
+// count the leaves to the given depth using the given number of threads
+static uint64_t perft(const Board& root, int depth, int threads, bool compact)
+{
+    // split deep enough that every thread gets several subtrees to balance the load
+    vector<Board> work;
+    int ply = 0;
+    split(root, ply, work);
+    while (threads > 1 && ply < depth - 1 && work.size() < 8 * (size_t)threads) {
+        work.clear();
+        split(root, ++ply, work);
+    }
+    atomic<size_t> next(0);
+    vector<uint64_t> counts(threads, 0);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&, t]() {
+            for (size_t i = next++; i < work.size(); i = next++) {
+                if (compact) {
+                    counts[t] += perft_board(work[i], depth - ply);
+                } else {
+                    Position pos(work[i]);
+                    counts[t] += perft_position(pos, depth - ply);
+                }
+            }
+        }));
+    }
+    uint64_t nodes = 0;
+    for (int t = 0; t < threads; t++) {
+        workers[t].join();
+        nodes += counts[t];
+    }
+    return nodes;
+}
+
+
+int main(int argc, char **argv) {
+    // command line format:
+    //   $ ./perft DEPTH [-pPOSITION] [-tTHREADS] [-gtable | -gshift | -gboard]
+    // counts every depth from 1 to DEPTH, from POSITION (in the format of
+    // Position::serialize) or the initial position, with the table or shift
+    // move generator on Position (default: shift), or on the compact Board
+    const char *usage = "usage: ./perft DEPTH [-pPOSITION] [-tTHREADS] [-gtable | -gshift | -gboard]\n";
+    if (argc < 2) {
+        printf("%s", usage);
+        exit(1);
+    }
+    int depth = stoi(argv[1]);
+    int threads = thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    string generator = "shift";
+    Board root = Position().board();
+    bool initial = true;
+    for (int i = 2; i < argc; i++) {
+        string f = argv[i];
+        if (f.rfind("-p", 0) == 0) {
+            if (!parse_position(f.substr(2), root)) {
+                printf("Error: position must be 64 squares of 'b', 'w' or '.' followed by 'b' or 'w'\n");
+                exit(1);
+            }
+            initial = false;
+        } else if (f.rfind("-t", 0) == 0) {
+            threads = stoi(f.substr(2));
+        } else if (f == "-gtable" || f == "-gshift" || f == "-gboard") {
+            generator = f.substr(2);
+        } else {
+            printf("%s", usage);
+            exit(1);
+        }
+    }
+    if (depth < 1 || threads < 1) {
+        printf("%s", usage);
+        exit(1);
+    }
+    Position::set_move_generator(generator == "table" ? MOVEGEN_TABLE : MOVEGEN_SHIFT);
+
+    // the bit primitives are used by every move generator, so check them first
+    int mismatches = check_bit_primitives();
+    cout << "bit primitives (" << bit_primitives_name() << "): "
+         << (mismatches ? "MISMATCH" : "OK") << endl;
+    cout << "move generator: " << generator << ", threads: " << threads << endl;
+    bool failed = (mismatches != 0);
+
+    for (int d = 1; d <= depth; d++) {
+        auto start = chrono::steady_clock::now();
+        uint64_t nodes = perft(root, d, threads, generator == "board");
+        auto finish = chrono::steady_clock::now();
+        chrono::duration<double> elapsed = finish - start;
+        printf("perft %2d: %15llu nodes %10.3f s %10.2f Mnodes/s", d, (unsigned long long)nodes,
+               elapsed.count(), nodes / elapsed.count() / 1e6);
+        if (initial && d < StartCountsNum) {
+            bool ok = (nodes == StartCounts[d]);
+            printf("  %s", ok ? "OK" : "MISMATCH");
+            failed |= !ok;
+        }
+        printf("\n");
+    }
+
+    return failed ? 1 : 0;
+}
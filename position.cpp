@@ -11,40 +11,119 @@ Position::Position()
 {
     uprightBB[BLACK] = 0x0000001008000000;
     uprightBB[WHITE] = 0x0000000810000000;
+    rotate_bitboards();
+    passed[BLACK] = false;
+    passed[WHITE] = false;
+    sideToMove = BLACK;
+    zobristKey = compute_hash();
+}
+
+
+// the minimal representative of the board under the 8 symmetries of the square
+// the rotations are composed from the reflections so that no transform is computed twice
+Board Board::canonical(Symmetry *sym) const
+{
+    Bitboard p[SYM_NUM], o[SYM_NUM];
+    p[SYM_IDENTITY]        = player;
+    p[SYM_FLIP_HORIZONTAL] = flip_horizontal(player);
+    p[SYM_FLIP_VERTICAL]   = flip_vertical(player);
+    p[SYM_FLIP_DIAG]       = flip_diag(player);
+    p[SYM_FLIP_ANTIDIAG]   = flip_antidiag(player);
+    p[SYM_ROTATE180]       = flip_vertical(p[SYM_FLIP_HORIZONTAL]);
+    p[SYM_ROTATE90_CW]     = flip_diag(p[SYM_FLIP_HORIZONTAL]);
+    p[SYM_ROTATE90_CCW]    = flip_antidiag(p[SYM_FLIP_HORIZONTAL]);
+    o[SYM_IDENTITY]        = opponent;
+    o[SYM_FLIP_HORIZONTAL] = flip_horizontal(opponent);
+    o[SYM_FLIP_VERTICAL]   = flip_vertical(opponent);
+    o[SYM_FLIP_DIAG]       = flip_diag(opponent);
+    o[SYM_FLIP_ANTIDIAG]   = flip_antidiag(opponent);
+    o[SYM_ROTATE180]       = flip_vertical(o[SYM_FLIP_HORIZONTAL]);
+    o[SYM_ROTATE90_CW]     = flip_diag(o[SYM_FLIP_HORIZONTAL]);
+    o[SYM_ROTATE90_CCW]    = flip_antidiag(o[SYM_FLIP_HORIZONTAL]);
+    int best = SYM_IDENTITY;
+    for (int s = 1; s < SYM_NUM; s++) {
+        if (p[s] < p[best] || (p[s] == p[best] && o[s] < o[best])) best = s;
+    }
+    if (sym != NULL) *sym = (Symmetry)best;
+    Board b;
+    b.player = p[best];
+    b.opponent = o[best];
+    b.state = state;
+    return b;
+}
+
+
+// construct from a compact board
+Position::Position(const Board& board)
+{
+    sideToMove = board.whose_turn();
+    uprightBB[sideToMove] = board.player;
+    uprightBB[sideToMove ^ 1] = board.opponent;
+    rotate_bitboards();
+    passed[BLACK] = (board.state >> (1 + BLACK)) & 1;
+    passed[WHITE] = (board.state >> (1 + WHITE)) & 1;
+    zobristKey = compute_hash();
+}
+
+
+// convert to a compact board
+Board Position::board(void)
+{
+    Board b;
+    b.player = uprightBB[sideToMove];
+    b.opponent = uprightBB[sideToMove ^ 1];
+    b.state = state();
+    return b;
+}
+
+
+// side to move and pass flags packed as in Board::state
+uint8_t Position::state(void)
+{
+    return sideToMove | (passed[BLACK] << (1 + BLACK)) | (passed[WHITE] << (1 + WHITE));
+}
+
+
+// recompute the rotated bitboards from the upright bitboards
+// only the TABLE move generator reads them, so SHIFT only marks them out of date
+void Position::rotate_bitboards(void)
+{
+    rotated = (movegen == MOVEGEN_TABLE);
+    if (!rotated) return;
     rotate90BB[BLACK] = rotate90_cw(uprightBB[BLACK]);
     rotate90BB[WHITE] = rotate90_cw(uprightBB[WHITE]);
     rotate45cwBB[BLACK] = pseudoRotate45_cw(uprightBB[BLACK]);
     rotate45cwBB[WHITE] = pseudoRotate45_cw(uprightBB[WHITE]);
     rotate45ccwBB[BLACK] = pseudoRotate45_ccw(uprightBB[BLACK]);
     rotate45ccwBB[WHITE] = pseudoRotate45_ccw(uprightBB[WHITE]);
-    passed[BLACK] = false;
-    passed[WHITE] = false;
-    sideToMove = BLACK;
 }
 
 
-// copy constructor
-Position::Position(const Position& position)
+MoveGenerator Position::movegen = MOVEGEN_TABLE;
+
+
+// select the move generator used by all positions
+void Position::set_move_generator(MoveGenerator g)
 {
-    uprightBB[BLACK] = position.uprightBB[BLACK];
-    uprightBB[WHITE] = position.uprightBB[WHITE];
-    rotate90BB[BLACK] = position.rotate90BB[BLACK];
-    rotate90BB[WHITE] = position.rotate90BB[WHITE];
-    rotate45cwBB[BLACK] = position.rotate45cwBB[BLACK];
-    rotate45cwBB[WHITE] = position.rotate45cwBB[WHITE];
-    rotate45ccwBB[BLACK] = position.rotate45ccwBB[BLACK];
-    rotate45ccwBB[WHITE] = position.rotate45ccwBB[WHITE];
-    passed[BLACK] = position.passed[BLACK];
-    passed[WHITE] = position.passed[WHITE];
-    sideToMove = position.sideToMove;
+    movegen = g;
 }
 
 
 // create all moves for the given player in the current position
+Bitboard Position::generate_moves(Color c)
+{
+    if (movegen == MOVEGEN_SHIFT)
+        return shift_moves(uprightBB[c], uprightBB[c^1]);
+    return generate_moves_table(c);
+}
+
+
+// create all moves for the given player using the Moves lookup table
 // for the sake of computation speed, this doesn't use any loops or function calls
 // all values are hardcoded for maximum efficiency
-Bitboard Position::generate_moves(Color c)
+Bitboard Position::generate_moves_table(Color c)
 {
+    if (!rotated) rotate_bitboards();
     Bitboard black, white, moves, all_moves = 0;
     // find all row moves in upright bitboard
     // use 0xff to extract the last 8 bits (a row)
@@ -183,6 +262,69 @@ Bitboard Position::generate_moves(Color c)
 void Position::make_move(int move, Color c)
 {
     if (move < 0) return pass(c);
+    uint8_t old_state = state();
+    Bitboard flips = place(move, c);
+    // update game state
+    passed[c] = false;
+    sideToMove ^= 1;
+    zobristKey ^= ZobristSquare[c][move] ^ zobrist_flips(flips) ^ zobrist_state(old_state) ^ zobrist_state(state());
+    return;
+}
+
+
+// make the given move and record in undo everything needed to take it back
+void Position::make_move(int move, Color c, Undo& undo)
+{
+    undo.move = move;
+    undo.color = c;
+    undo.state = state();
+    undo.flips = 0;
+    if (move < 0) return pass(c);
+    undo.flips = place(move, c);
+    passed[c] = false;
+    sideToMove ^= 1;
+    zobristKey ^= ZobristSquare[c][move] ^ zobrist_flips(undo.flips) ^ zobrist_state(undo.state) ^ zobrist_state(state());
+    return;
+}
+
+
+// restore the position as it was before the move recorded in undo
+void Position::undo_move(const Undo& undo)
+{
+    // every change to the hash is an XOR, so undoing it repeats the same changes
+    zobristKey ^= zobrist_state(state()) ^ zobrist_state(undo.state);
+    if (undo.move >= 0) {
+        Color c = (Color)undo.color;
+        uprightBB[c]   ^= undo.flips | (1ULL << undo.move);
+        uprightBB[c^1] ^= undo.flips;
+        rotate_bitboards();
+        zobristKey ^= ZobristSquare[c][undo.move] ^ zobrist_flips(undo.flips);
+    }
+    sideToMove = undo.state & 1;
+    passed[BLACK] = (undo.state >> (1 + BLACK)) & 1;
+    passed[WHITE] = (undo.state >> (1 + WHITE)) & 1;
+}
+
+
+// place a piece for the given player and flip all captured pieces
+// returns the flipped pieces
+Bitboard Position::place(int move, Color c)
+{
+    if (movegen == MOVEGEN_TABLE) return place_table(move, c);
+    // upright bitboards only
+    Bitboard m = 1ULL << move;
+    Bitboard flips = shift_flips(uprightBB[c], uprightBB[c^1], m);
+    uprightBB[c]   ^= flips | m;
+    uprightBB[c^1] ^= flips;
+    rotated = false;
+    return flips;
+}
+
+
+// place a piece using the Captures table, then bring the rotated bitboards up to date
+Bitboard Position::place_table(int move, Color c)
+{
+    if (!rotated) rotate_bitboards();
     // find all the captures (in all 4 directions)
     unsigned char offset, length, index;
     unsigned char black, white;
@@ -222,16 +364,8 @@ void Position::make_move(int move, Color c)
     uprightBB[c]   |= m;
     uprightBB[c]   ^= all_captures;
     uprightBB[c^1] ^= all_captures;
-    rotate90BB[BLACK] = rotate90_cw(uprightBB[BLACK]);
-    rotate90BB[WHITE] = rotate90_cw(uprightBB[WHITE]);
-    rotate45cwBB[BLACK] = pseudoRotate45_cw(uprightBB[BLACK]);
-    rotate45cwBB[WHITE] = pseudoRotate45_cw(uprightBB[WHITE]);
-    rotate45ccwBB[BLACK] = pseudoRotate45_ccw(uprightBB[BLACK]);
-    rotate45ccwBB[WHITE] = pseudoRotate45_ccw(uprightBB[WHITE]);
-    // update game state
-    passed[c] = false;
-    sideToMove ^= 1;
-    return;
+    rotate_bitboards();
+    return all_captures;
 }
 
 
@@ -311,8 +445,10 @@ int Position::outcome(void)
 // pass a turn for the given player (only called when player has no legal moves)
 void Position::pass(Color c)
 {
+    uint8_t old_state = state();
     sideToMove ^= 1;
     passed[c] = true;
+    zobristKey ^= zobrist_state(old_state) ^ zobrist_state(state());
 }
 
 // accessors
@@ -320,3 +456,17 @@ Bitboard Position::get_blackBB(void) { return uprightBB[BLACK]; }
 Bitboard Position::get_whiteBB(void) { return uprightBB[WHITE]; }
 
 
+// Zobrist hash of the position, kept up to date by every move
+uint64_t Position::hash(void)
+{
+    return zobristKey;
+}
+
+
+// Zobrist hash of the position computed from scratch
+uint64_t Position::compute_hash(void)
+{
+    return zobrist_pieces(uprightBB[BLACK], BLACK) ^ zobrist_pieces(uprightBB[WHITE], WHITE) ^ zobrist_state(state());
+}
+
+
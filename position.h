@@ -1,20 +1,160 @@
 #ifndef POSITION_H
 #define POSITION_H
 
+#include <cstddef>
 #include <vector>
+#include <string>
+#include <type_traits>
 #include "bitboard.h"
 
 
+// the algorithms Position can use to generate and make moves; both give identical results
+// TABLE looks up Moves[][][] and Captures[][][][] on the upright and rotated bitboards
+// SHIFT works on the upright bitboards with directional shifts and leaves the rotated
+// bitboards out of date, which TABLE brings up to date the next time it needs them
+enum MoveGenerator : int {
+    MOVEGEN_TABLE, MOVEGEN_SHIFT
+};
+
+
+// Zobrist hash of the pieces in b, all of color c
+inline uint64_t zobrist_pieces(Bitboard b, Color c) {
+    uint64_t key = 0;
+    for (; b; b &= b - 1)
+        key ^= ZobristSquare[c][__builtin_ctzll(b)];
+    return key;
+}
+
+
+// change of the Zobrist hash when the pieces in flips change color
+inline uint64_t zobrist_flips(Bitboard flips) {
+    uint64_t key = 0;
+    for (; flips; flips &= flips - 1)
+        key ^= ZobristFlip[__builtin_ctzll(flips)];
+    return key;
+}
+
+
+// Zobrist hash of the side to move and passed flags, packed as in Board::state
+inline uint64_t zobrist_state(uint8_t state) {
+    return ZobristState[state & 7];
+}
+
+
+// everything make_move needs to remember so that undo_move can take the move back
+struct Undo {
+    // pieces flipped by the move (0 for a pass)
+    Bitboard flips;
+    // the square played, or -1 for a pass
+    int8_t move;
+    // the player who made the move
+    uint8_t color;
+    // side to move and pass flags before the move, packed as in Board::state
+    uint8_t state;
+};
+
+
+// a compact, trivially copyable position for search and rollouts
+// it always uses the shift-based algorithms, independent of the selected MoveGenerator
+struct Board {
+    // pieces of the side to move and of the other side
+    Bitboard player;
+    Bitboard opponent;
+    // bit 0: whose turn it is; bit 1 + c: whether player c passed on their last turn
+    uint8_t state;
+
+    // output which player's turn it is
+    int whose_turn(void) const { return state & 1; }
+    // create all moves for the side to move
+    Bitboard generate_moves(void) const { return shift_moves(player, opponent); }
+    // make the given move (must be legal, or negative to pass) for the side to move
+    void make_move(int move) {
+        if (move < 0) return pass();
+        Bitboard m = 1ULL << move;
+        Bitboard flips = shift_flips(player, opponent, m);
+        Bitboard p = player ^ (flips | m);
+        player = opponent ^ flips;
+        opponent = p;
+        state = (state & ~(2 << whose_turn())) ^ 1;
+    }
+    // make a move as above and record in undo how to take it back
+    void make_move(int move, Undo& undo) {
+        undo.move = move;
+        undo.color = whose_turn();
+        undo.state = state;
+        undo.flips = 0;
+        if (move < 0) return pass();
+        undo.flips = shift_flips(player, opponent, 1ULL << move);
+        Bitboard p = player ^ (undo.flips | (1ULL << move));
+        player = opponent ^ undo.flips;
+        opponent = p;
+        state = (state & ~(2 << whose_turn())) ^ 1;
+    }
+    // restore the board as it was before the move recorded in undo
+    void undo_move(const Undo& undo) {
+        Bitboard p = opponent;
+        opponent = player;
+        player = p;
+        if (undo.move >= 0) {
+            player ^= undo.flips | (1ULL << undo.move);
+            opponent ^= undo.flips;
+        }
+        state = undo.state;
+    }
+    // pass a turn for the side to move
+    void pass(void) {
+        Bitboard p = player;
+        player = opponent;
+        opponent = p;
+        state = (state | (2 << whose_turn())) ^ 1;
+    }
+    // determine if the game is over
+    bool game_over(void) const {
+        return ((~(player | opponent) == 0) ||            // all squares are occupied
+                ((state & 6) == 6) ||                     // neither player has available moves
+                (player == 0 || opponent == 0));          // either color is 100% captured
+    }
+    // accessors for the pieces of each color
+    Bitboard get_blackBB(void) const { return whose_turn() == BLACK ? player : opponent; }
+    Bitboard get_whiteBB(void) const { return whose_turn() == BLACK ? opponent : player; }
+    // Zobrist hash of the board, computed from scratch; equal to Position::hash()
+    uint64_t hash(void) const {
+        return zobrist_pieces(get_blackBB(), BLACK) ^ zobrist_pieces(get_whiteBB(), WHITE) ^ zobrist_state(state);
+    }
+    // the minimal representative of the board under the 8 symmetries of the square
+    // (smallest player, then opponent bitboard); if sym is given, it receives the
+    // symmetry that maps this board onto the representative, so that moves map with
+    // transform_square(move, sym) and back with transform_square(move, inverse(sym))
+    Board canonical(Symmetry *sym = NULL) const;
+    // determine who won the game (or if it is a draw); UNDEFINED behavior if game not over
+    int outcome(void) const {
+        int b = popcount(get_blackBB());
+        int w = popcount(get_whiteBB());
+        return (b > w) - (b < w);
+    }
+};
+
+static_assert(std::is_trivially_copyable<Board>::value, "Board must be trivially copyable");
+
+
 class Position {
 public:
+    // select the move generator used by all positions (MOVEGEN_TABLE by default)
+    static void set_move_generator(MoveGenerator g);
     // constructor
     Position ();
-    // copy constructor
-    Position (const Position& position);
+    // construct from a compact board
+    explicit Position (const Board& board);
+    // convert to a compact board
+    Board board(void);
     // create all moves for the given player in the current position
     Bitboard generate_moves(Color c);
     // make the given move (must be legal) for the given player in the current position
     void make_move(int move, Color c);
+    // make a move as above and record in undo how to take it back
+    void make_move(int move, Color c, Undo& undo);
+    // restore the position as it was before the move recorded in undo
+    void undo_move(const Undo& undo);
     // print the board to the command line in a human-friendly format
     void pretty(void);
     // convert a bitboard containing moves to a vector
@@ -33,17 +173,37 @@ public:
     Bitboard get_whiteBB(void);
     // output into a string, row by row, upper-left to lower-right
     std::string serialize(void);
+    // 64-bit Zobrist hash of the pieces, side to move and passed flags, kept up to date by every move
+    uint64_t hash(void);
+    // the same hash computed from scratch, to verify the incremental updates
+    uint64_t compute_hash(void);
 
 private:
+    // the move generator currently in use
+    static MoveGenerator movegen;
+    // generate moves using lookups into the Moves table
+    Bitboard generate_moves_table(Color c);
+    // place a piece for the given player and flip all captured pieces; returns the flipped pieces
+    Bitboard place(int move, Color c);
+    // place a piece using lookups into the Captures table
+    Bitboard place_table(int move, Color c);
+    // side to move and pass flags packed as in Board::state
+    uint8_t state(void);
+    // recompute the rotated bitboards from the upright bitboards
+    void rotate_bitboards(void);
     // 8 bitboards, 4 for each color: upright, clockwise 90, clockwise 45, counterclockwise 45
     Bitboard uprightBB[COLOR_NUM];
     Bitboard rotate90BB[COLOR_NUM];
     Bitboard rotate45cwBB[COLOR_NUM];
     Bitboard rotate45ccwBB[COLOR_NUM];
+    // whether the rotated bitboards match the upright bitboards
+    bool rotated;
     // two flags to record whether or not each player passed the last time they are supposed to move
     bool passed[COLOR_NUM];
     // flag indicating whose turn it is
     int sideToMove;
+    // Zobrist hash of the position
+    uint64_t zobristKey;
 };
 
 
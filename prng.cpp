@@ -0,0 +1,78 @@
+#include <ctime>
+#include <mutex>
+#include "prng.h"
+
+using namespace std;
+
+
+// constructor: splitmix64 turns any seed, even 0, into a well mixed state
+Random::Random(uint64_t seed)
+{
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        s[i] = z ^ (z >> 31);
+    }
+}
+
+
+// a new generator for the next 2^128 numbers of this one
+Random Random::split(void)
+{
+    Random r = *this;
+    jump();
+    return r;
+}
+
+
+// advance the state by 2^128 numbers, with the jump polynomial of xoshiro256
+void Random::jump(void)
+{
+    static const uint64_t JUMP[] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+    uint64_t t[4] = {0, 0, 0, 0};
+    for (uint64_t j : JUMP) {
+        for (int b = 0; b < 64; b++) {
+            if (j & (1ULL << b)) {
+                for (int i = 0; i < 4; i++)
+                    t[i] ^= s[i];
+            }
+            next();
+        }
+    }
+    for (int i = 0; i < 4; i++)
+        s[i] = t[i];
+}
+
+
+// the seed, and the generator the streams are split off from
+static uint64_t seed = time(NULL);
+static Random streams(seed);
+static mutex streams_mutex;
+
+
+// seed all random numbers of the program
+void seed_random(uint64_t s)
+{
+    lock_guard<mutex> lock(streams_mutex);
+    seed = s;
+    streams = Random(s);
+}
+
+
+// the seed in use
+uint64_t random_seed(void)
+{
+    return seed;
+}
+
+
+// a new stream split off from the seed
+Random random_stream(void)
+{
+    lock_guard<mutex> lock(streams_mutex);
+    return streams.split();
+}
+
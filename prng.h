@@ -0,0 +1,69 @@
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <cstdint>
+
+
+// a small, fast pseudorandom generator (xoshiro256**, seeded with splitmix64)
+// a generator must only be used by one thread at a time; threads get their own with
+// thread_random below, each a separate stream split off from one global seed
+class Random {
+public:
+    // constructor: the state is filled from seed with splitmix64
+    Random(uint64_t seed = 0);
+    // the next 64 random bits
+    uint64_t next(void) {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+    // a uniformly random integer in [0, n), for n > 0
+    // Lemire's multiply-and-shift, which only divides in the rare case it has to reject
+    uint32_t below(uint32_t n) {
+        uint64_t m = (next() >> 32) * n;
+        if ((uint32_t)m < n) {
+            uint32_t threshold = -n % n;
+            while ((uint32_t)m < threshold)
+                m = (next() >> 32) * n;
+        }
+        return m >> 32;
+    }
+    // a new generator for the next 2^128 numbers of this one, which skips past them, so
+    // that the generators split off one after another never overlap
+    Random split(void);
+
+private:
+    uint64_t s[4];
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+    // advance the state by 2^128 numbers
+    void jump(void);
+};
+
+
+// seed all random numbers of the program; to be called before any thread draws one, so
+// that a run with the same seed (and the same iteration budgets) plays the same way
+// without it, the seed is taken from the clock
+void seed_random(uint64_t seed);
+
+// the seed in use
+uint64_t random_seed(void);
+
+// a new stream split off from the seed; streams are handed out in the order they are asked for
+Random random_stream(void);
+
+// the generator of the calling thread, a new stream the first time a thread asks for it
+// a thread may also replace it with a stream of its own, e.g. one per search worker
+inline Random& thread_random(void)
+{
+    thread_local Random generator = random_stream();
+    return generator;
+}
+
+
+#endif
@@ -0,0 +1,125 @@
+#include <fdeep/fdeep.hpp>
+#include "bitboard.h"
+#include "batch.h"
+#include "position.h"
+#include "rollout.h"
+#include "prng.h"
+
+using namespace std;
+
+
+// load model for CNN
+fdeep::model Model = fdeep::load_model("move_predictor/trained_symmetric_fdeep.json");
+
+// define follout policies for unbiased, biased, and CNN-default
+
+// the move of the unbiased policy among the given legal moves: any, uniformly at random
+static int pick_unbiased(Bitboard moves_bb)
+{
+    // for performance reasons, we don't use Position.bb2vec to pick a random move
+    // rollouts run on every search thread, each with its own generator
+    int r = 1 + thread_random().below(popcount(moves_bb));
+    return 64 - rth_setbit_position(moves_bb, r);
+}
+
+// the move of the biased policy among the given legal moves
+static int pick_biased(Bitboard moves_bb)
+{
+    Bitboard pool = moves_bb;
+    // first prioritize corner squares
+    pool &= 0x8100000000000081;
+    if (pool == 0) pool = moves_bb;
+    // next eliminate b2, b7, g2, g7, if possible
+    pool &= 0xffbdffffffffbdff;
+    if (pool == 0) pool = moves_bb;
+    return pick_unbiased(pool);
+}
+
+// Unbiased default policy
+// pick uniformly randomly from all legal moves
+int RolloutUnbiased(Board& pos)
+{
+    while (!pos.game_over()) {
+        Bitboard moves_bb = pos.generate_moves();
+        if (!moves_bb) {
+            pos.pass();
+            continue;
+        }
+        pos.make_move(pick_unbiased(moves_bb));
+    }
+    return pos.outcome();
+}
+
+// Biased default policy
+// if corner moves are available, then make one of the corner moves
+// otherwise if there are moves other than b2, b7, g2, g7 available, choose one of those
+// otherwise choose one of b2, b7, g2, g7
+int RolloutBiased(Board& pos)
+{
+    while (!pos.game_over()) {
+        Bitboard moves_bb = pos.generate_moves();
+        if (!moves_bb) {
+            pos.pass();
+            continue;
+        }
+        pos.make_move(pick_biased(moves_bb));
+    }
+    return pos.outcome();
+}
+
+// the unbiased and biased policies for k games at once, played in lockstep
+int RolloutUnbiasedLanes(const Board& pos, int k)
+{
+    return playouts_batch(pos, k, &pick_unbiased);
+}
+
+int RolloutBiasedLanes(const Board& pos, int k)
+{
+    return playouts_batch(pos, k, &pick_biased);
+}
+
+// CNN default policy
+// use CNN classifier to predict moves each time
+int RolloutCNN(Board& pos)
+{
+    while (!pos.game_over()) {
+        Bitboard moves_bb = pos.generate_moves();
+        if (!moves_bb) {
+            pos.pass();
+            continue;
+        }
+        // get board information and run model forward pass
+        Bitboard black_out = pos.player;
+        Bitboard white_out = pos.opponent;
+        fdeep::tensor T(fdeep::tensor_shape(8, 8, 2), 0);
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                int index = i * 8 + j; // rank of the bit
+                T.set(fdeep::tensor_pos(7-i, j, 0), (black_out >> index) & 0x1);
+                T.set(fdeep::tensor_pos(7-i, j, 1), (white_out >> index) & 0x1);
+            }
+        }
+        auto result = Model.predict({T}); // returns vector of fdeep::internal::tensor
+        auto outvec = result[0].to_vector();
+
+        // cull the output vector by the legal moves
+        for (int i = 0; i < 27; i++) outvec[i] *= ((moves_bb >> i) & 0x1);
+        for (int i = 27; i < 33; i++) outvec[i] *= ((moves_bb >> (i + 2)) & 0x1);
+        for (int i = 33; i < 60; i++) outvec[i] *= ((moves_bb >> (i + 4)) & 0x1);
+
+        // output best move by finding index for argmax and remapping to board
+        float max = -1;
+        int move = -1;
+        for (size_t i = 0; i < outvec.size(); i++) {
+            if (outvec[i] > max) {
+                max = outvec[i];
+                move = i;
+            }
+        }
+        if (move >= 33) move += 4;
+        else if (move < 33 && move >= 27) move += 2;
+
+        pos.make_move(move);
+    }
+    return pos.outcome();
+}
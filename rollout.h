@@ -0,0 +1,29 @@
+#ifndef ROLLOUT_H
+#define ROLLOUT_H
+
+#include <fdeep/fdeep.hpp>
+#include "position.h"
+
+
+// the CNN move predictor, loaded when the program starts
+extern fdeep::model Model;
+
+// rollout policies for MCTSComputerAgent (see Rollout in agent.h)
+// each plays out the compact board in place and returns the game outcome
+
+// Unbiased default policy: pick uniformly randomly from all legal moves
+int RolloutUnbiased(Board& pos);
+
+// Biased default policy: prefer corners, and avoid b2, b7, g2, g7 when possible
+int RolloutBiased(Board& pos);
+
+// CNN default policy: play the move the CNN predicts
+int RolloutCNN(Board& pos);
+
+// the unbiased and biased policies for k games from pos at once, in lockstep across the SIMD
+// lanes of the batch kernel (see playouts_batch in batch.h); return the sum of the outcomes
+int RolloutUnbiasedLanes(const Board& pos, int k);
+int RolloutBiasedLanes(const Board& pos, int k);
+
+
+#endif
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include "solver.h"
+
+using namespace std;
+
+
+// positions with fewer empty squares than this are searched without the table ...
+static const int TABLE_EMPTIES = 7;
+// ... and have their moves ordered by parity alone
+static const int SORT_EMPTIES = 7;
+
+// the four quadrants of the board, the regions used for parity
+static const Bitboard QUADRANTS[4] = {
+    0x000000000F0F0F0FULL, 0x00000000F0F0F0F0ULL, 0x0F0F0F0F00000000ULL, 0xF0F0F0F000000000ULL
+};
+
+
+// constructor
+Solver::Solver(size_t table_size) : nodes(0)
+{
+    size_t size = 1;
+    while (size * 2 <= table_size)
+        size *= 2;
+    table = vector<Entry>(size);
+    mask = size - 1;
+}
+
+
+// the outcome with perfect play: 1 if black wins, 0 if it is a draw, -1 if white wins
+// only the sign of the score matters, so a null window around 0 is enough
+int Solver::outcome(const Board& pos)
+{
+    if (pos.game_over()) return pos.outcome();
+    int v = search(pos.player, pos.opponent, -1, 1);
+    int o = (v > 0) - (v < 0);
+    return (pos.whose_turn() == BLACK) ? o : -o;
+}
+
+
+// the final disc difference for the side to move with perfect play
+int Solver::score(const Board& pos)
+{
+    if (pos.game_over()) return popcount(pos.player) - popcount(pos.opponent);
+    return search(pos.player, pos.opponent, -64, 64);
+}
+
+
+// the table entry of a position
+Solver::Entry& Solver::entry(Bitboard player, Bitboard opponent)
+{
+    uint64_t h = player * 0x9e3779b97f4a7c15ULL ^ opponent * 0xc2b2ae3d27d4eb4fULL;
+    return table[(h ^ (h >> 29)) & mask];
+}
+
+
+// fail-soft alpha-beta search of the position, with player to move
+int Solver::search(Bitboard player, Bitboard opponent, int alpha, int beta)
+{
+    nodes++;
+    Bitboard moves_bb = shift_moves(player, opponent);
+    if (moves_bb == 0) {
+        // neither side can move: the game is over
+        if (shift_moves(opponent, player) == 0)
+            return popcount(player) - popcount(opponent);
+        return -search(opponent, player, -beta, -alpha);
+    }
+    Bitboard empty = ~(player | opponent);
+    int empties = popcount(empty);
+
+    // narrow the window with the bounds from the table, or return at once
+    Entry *e = NULL;
+    int hint = -1;
+    if (empties >= TABLE_EMPTIES) {
+        e = &entry(player, opponent);
+        if (e->player == player && e->opponent == opponent) {
+            if (e->lower >= beta) return e->lower;
+            if (e->upper <= alpha) return e->upper;
+            if (e->lower == e->upper) return e->lower;
+            alpha = max(alpha, (int)e->lower);
+            beta = min(beta, (int)e->upper);
+            hint = e->move;
+        }
+    }
+
+    // the moves in search order (a move per empty square at most)
+    int moves[64], n = 0;
+    Bitboard odd = 0;
+    for (Bitboard q : QUADRANTS)
+        if (popcount(empty & q) & 1) odd |= q;
+    if (empties >= SORT_EMPTIES) {
+        // fewest replies first, then odd regions, then the best move from the table above all
+        int keys[64];
+        for (Bitboard bb = moves_bb; bb; bb &= bb - 1) {
+            int m = bit_pos(bb & (~bb + 1));
+            Bitboard flips = shift_flips(player, opponent, 1ULL << m);
+            int key = popcount(shift_moves(opponent ^ flips, player ^ flips ^ (1ULL << m))) * 2;
+            if (odd & (1ULL << m)) key -= 1;
+            if (m == hint) key = -2;
+            int i = n++;
+            for (; i > 0 && keys[i - 1] > key; i--) {
+                keys[i] = keys[i - 1];
+                moves[i] = moves[i - 1];
+            }
+            keys[i] = key;
+            moves[i] = m;
+        }
+    } else {
+        // odd regions first
+        for (Bitboard bb = moves_bb & odd; bb; bb &= bb - 1)
+            moves[n++] = bit_pos(bb & (~bb + 1));
+        for (Bitboard bb = moves_bb & ~odd; bb; bb &= bb - 1)
+            moves[n++] = bit_pos(bb & (~bb + 1));
+    }
+
+    // search the moves
+    int a = alpha;
+    int best = -65, best_move = -1;
+    for (int i = 0; i < n && a < beta; i++) {
+        Bitboard m = 1ULL << moves[i];
+        Bitboard flips = shift_flips(player, opponent, m);
+        int v = -search(opponent ^ flips, player ^ flips ^ m, -beta, -a);
+        if (v > best) {
+            best = v;
+            best_move = moves[i];
+            a = max(a, v);
+        }
+    }
+
+    // a score at or below alpha is an upper bound, one at or above beta a lower bound
+    if (e != NULL) {
+        if (e->player != player || e->opponent != opponent) {
+            e->player = player;
+            e->opponent = opponent;
+            e->lower = -64;
+            e->upper = 64;
+        }
+        if (best > alpha) e->lower = best;
+        if (best < beta) e->upper = best;
+        e->move = best_move;
+    }
+    return best;
+}
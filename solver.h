@@ -0,0 +1,47 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <cstdint>
+#include <vector>
+#include "bitboard.h"
+#include "position.h"
+
+
+// exact endgame solver: alpha-beta search to the end of the game on the compact Board
+// moves are ordered by the transposition table's best move first, then by the opponent's
+// mobility after the move (fastest-first), with moves into regions with an odd number of
+// empty squares (parity) breaking ties; near the end, parity alone orders the moves
+// scores are final disc differences for the side to move, empty squares not counted, as in
+// Board::outcome
+// a Solver must only be used by one thread at a time
+class Solver {
+public:
+    // constructor: room for the given number of transposition table entries, rounded down
+    // to a power of two
+    Solver(size_t table_size = 1 << 18);
+    // the outcome with perfect play: 1 if black wins, 0 if it is a draw, -1 if white wins
+    int outcome(const Board& pos);
+    // the final disc difference for the side to move with perfect play
+    int score(const Board& pos);
+    // number of positions searched since the solver was created
+    uint64_t nodes;
+
+private:
+    // lower and upper bounds on the score of a position, and its best move
+    struct Entry {
+        Bitboard player;
+        Bitboard opponent;
+        int8_t lower;
+        int8_t upper;
+        int8_t move;
+    };
+    std::vector<Entry> table;
+    uint64_t mask;
+    // fail-soft alpha-beta search of the position
+    int search(Bitboard player, Bitboard opponent, int alpha, int beta);
+    // the table entry of a position
+    Entry& entry(Bitboard player, Bitboard opponent);
+};
+
+
+#endif
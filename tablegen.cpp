@@ -0,0 +1,304 @@
+/* The purpose of tablegen.cpp is to compute all the move and capture lookup
+ * tables and the Zobrist keys declared in bitboard.h and print them as C++ source (tables.cpp),
+ * so that they are compiled into read-only data instead of being computed
+ * every time a program starts. The Makefile runs it as part of the build:
+ *   $ ./tablegen > tables.cpp
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "bitboard.h"
+
+using namespace std;
+
+
+// working copies of the tables, filled in here and then printed
+static Move moves[256][256][2];
+static Capture captures[256][256][2][8];
+static unsigned char offsetUpright[64];
+static unsigned char offsetRotate90[64];
+static unsigned char offsetRotate45CW[64];
+static unsigned char offsetRotate45CCW[64];
+static unsigned char lengthRotate45CW[64];
+static unsigned char lengthRotate45CCW[64];
+static unsigned char indexUpright[64];
+static unsigned char indexRotate90[64];
+static unsigned char indexRotate45CW[64];
+static unsigned char indexRotate45CCW[64];
+
+
+// a helper for computing move values
+static Move computeMoves(unsigned char self, unsigned char enemy, int length)
+{
+    unsigned char unoccupied = ~(self | enemy);
+    unsigned char captured;
+    unsigned char moves = 0;
+    captured = (self << 1) & enemy;
+    for (int i = 0; i < length - 3; i++)
+        captured |= (captured << 1) & enemy;
+    moves |= (captured << 1) & unoccupied;
+    captured = (self >> 1) & enemy;
+    for (int i = 0; i < length - 3; i++)
+        captured |= (captured >> 1) & enemy;
+    moves |= (captured >> 1) & unoccupied;
+    return moves;
+}
+
+// a helper for computing capture values
+static Capture computeCaptures(unsigned char self, unsigned char enemy, int length, int loc)
+{
+    unsigned char unoccupied = ~(self | enemy);
+    unsigned char piece_mask;
+    unsigned char left_captured, right_captured;
+    // try to place a piece of SELF at LOC, and then compute captures for it
+    piece_mask = 1 << loc;
+    if ((piece_mask & unoccupied) == 0) return 0;
+    // capture to the right, use <<
+    right_captured = (piece_mask << 1) & enemy;
+    for (int i = 0; i < length - 3; i++)
+        right_captured |= (right_captured << 1) & enemy;
+    if (((right_captured << 1) & self) == 0) right_captured = 0;
+    // capture to the left, use >>
+    left_captured = (piece_mask >> 1) & enemy;
+    for (int i = 0; i < length - 3; i++)
+        left_captured |= (left_captured >> 1) & enemy;
+    if (((left_captured >> 1) & self) == 0) left_captured = 0;
+    return right_captured | left_captured;
+}
+
+
+// this function computes all the move and capture cache values
+static void computeMovesCaptures(void)
+{
+    unsigned int i, j, k;
+    for (i = 0; i < 256; i++) {
+        for (j = 0; j < 256; j++) {
+            moves[i][j][BLACK] = computeMoves(i, j, 8);
+            moves[i][j][WHITE] = computeMoves(j, i, 8);
+            for (k = 0; k < 8; k++) {
+                captures[i][j][BLACK][k] = computeCaptures(i, j, 8, k);
+                captures[i][j][WHITE][k] = computeCaptures(j, i, 8, k);
+            }
+        }
+    }
+}
+
+
+// this function computes all the captures offsets/lengths/indices
+static void computeCapturesTables(void)
+{
+    // upright board offset
+    for (int i = 0; i < 64; i++)
+        offsetUpright[i] = (i >> 3) * 8;
+    // rotate90 board offset
+    for (int i = 0; i < 64; i++)
+        offsetRotate90[i] = (7 - (i & 7)) * 8;
+    // rotate45 cw board offset and length
+    for (int i = 0; i < 64; i++) {
+        offsetRotate45CW[i] = (((i >> 3) + (8 - (i & 7))) & 7) * 8;
+        if (i % 9 == 0) {
+            lengthRotate45CW[i] = 8;
+        } else if (i % 9 == 8 || i % 9 == 1) {
+            lengthRotate45CW[i] = 7;
+        } else if (i % 9 == 2) {
+            lengthRotate45CW[i] = (i >= 56) ? 1 : 6;
+        } else if (i % 9 == 3) {
+            lengthRotate45CW[i] = (i >= 48) ? 2 : 5;
+        } else if (i % 9 == 4) {
+            lengthRotate45CW[i] = (i >= 40) ? 3 : 4;
+        } else if (i % 9 == 5) {
+            lengthRotate45CW[i] = (i >= 32) ? 4 : 3;
+        } else if (i % 9 == 6) {
+            lengthRotate45CW[i] = (i >= 24) ? 5 : 2;
+        } else if (i % 9 == 7) {
+            lengthRotate45CW[i] = (i >= 16) ? 6 : 1;
+        } else cerr << "bug!!" << endl;
+    }
+    for (int i = 0; i < 64; i++) {
+        switch(offsetRotate45CW[i]) {
+            case 0: break;
+            case 8: if (i <= 7) offsetRotate45CW[i] += 7; break;
+            case 16: if (i <= 15) offsetRotate45CW[i] += 6; break;
+            case 24: if (i <= 23) offsetRotate45CW[i] += 5; break;
+            case 32: if (i <= 31) offsetRotate45CW[i] += 4; break;
+            case 40: if (i <= 39) offsetRotate45CW[i] += 3; break;
+            case 48: if (i <= 47) offsetRotate45CW[i] += 2; break;
+            case 56: if (i <= 55) offsetRotate45CW[i] += 1; break;
+            default: cerr << "bug!!" << endl;
+        }
+    }
+    // rotate45 ccw board offset and length
+    for (int i = 0; i < 64; i++) {
+        offsetRotate45CCW[i] = (((i >> 3) + (1 + (i & 7))) & 7) * 8;
+        if (i % 7 == 0) {
+            lengthRotate45CCW[i] = (i == 0 || i == 63) ? 1 : 8;
+        } else if (i % 7 == 1) {
+            lengthRotate45CCW[i] = (i <= 8) ? 2 : 7;
+        } else if (i % 7 == 2) {
+            lengthRotate45CCW[i] = (i <= 16) ? 3 : 6;
+        } else if (i % 7 == 3) {
+            lengthRotate45CCW[i] = (i <= 24) ? 4 : 5;
+        } else if (i % 7 == 4) {
+            lengthRotate45CCW[i] = (i <= 32) ? 5 : 4;
+        } else if (i % 7 == 5) {
+            lengthRotate45CCW[i] = (i <= 40) ? 6 : 3;
+        } else if (i % 7 == 6) {
+            lengthRotate45CCW[i] = (i <= 48) ? 7 : 2;
+        } else cerr << "bug!!!" << endl;
+    }
+    for (int i = 0; i < 64; i++) {
+        switch(offsetRotate45CCW[i]) {
+            case 0: break;
+            case 8: if (i >= 15) offsetRotate45CCW[i] += 1; break;
+            case 16: if (i >= 23) offsetRotate45CCW[i] += 2; break;
+            case 24: if (i >= 31) offsetRotate45CCW[i] += 3; break;
+            case 32: if (i >= 39) offsetRotate45CCW[i] += 4; break;
+            case 40: if (i >= 47) offsetRotate45CCW[i] += 5; break;
+            case 48: if (i >= 55) offsetRotate45CCW[i] += 6; break;
+            case 56: if (i >= 63) offsetRotate45CCW[i] += 7; break;
+            default: cerr << "bug!!!" << endl;
+        }
+    }
+
+    // compute indices
+    for (int i = 0; i < 64; i++) {
+        indexUpright[i] = i & 7;
+    }
+    for (int i = 0; i < 64; i++) {
+        indexRotate90[i] = i >> 3;
+    }
+    for (int i = 0; i < 64; i++) {
+        if (offsetRotate45CW[i] % 8 == 0) {
+            indexRotate45CW[i] = (i - offsetRotate45CW[i]) / 9;
+        } else {
+            indexRotate45CW[i] = i / 9;
+        }
+    }
+    for (int i = 0; i < 64; i++) {
+        if (offsetRotate45CCW[i] % 8 == 0) {
+            if (offsetRotate45CCW[i] == 0) indexRotate45CCW[i] = 8 - i / 7;
+            else indexRotate45CCW[i] = (((offsetRotate45CCW[i] + 56) % 64) >> 3) - i / 7;
+        } else {
+            if (i == 63) indexRotate45CCW[i] = 0;
+            else indexRotate45CCW[i] = 8 - i / 7;
+        }
+    }
+    return;
+}
+
+
+// Zobrist keys for hashing positions
+static uint64_t zobristSquare[2][64];
+static uint64_t zobristFlip[64];
+static uint64_t zobristState[8];
+
+
+// splitmix64, a simple generator of well-mixed 64-bit values
+static uint64_t splitmix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+
+// this function computes the Zobrist keys from a fixed seed, so that hashes are
+// the same across builds
+static void computeZobrist(void)
+{
+    uint64_t seed = 0x0123456789abcdef;
+    for (int c = 0; c < 2; c++)
+        for (int i = 0; i < 64; i++)
+            zobristSquare[c][i] = splitmix64(seed);
+    for (int i = 0; i < 64; i++)
+        zobristFlip[i] = zobristSquare[BLACK][i] ^ zobristSquare[WHITE][i];
+    // the state byte packs whose turn it is and the passed flags, see Board::state
+    uint64_t side = splitmix64(seed);
+    uint64_t passed[2];
+    passed[BLACK] = splitmix64(seed);
+    passed[WHITE] = splitmix64(seed);
+    for (int s = 0; s < 8; s++) {
+        zobristState[s] = 0;
+        if (s & 1) zobristState[s] ^= side;
+        if (s & (2 << BLACK)) zobristState[s] ^= passed[BLACK];
+        if (s & (2 << WHITE)) zobristState[s] ^= passed[WHITE];
+    }
+}
+
+
+// print one value of a table
+static void print_value(unsigned char value) { cout << (int)value; }
+static void print_value(uint64_t value) { cout << "0x" << hex << value << dec; }
+
+
+// print the values of a table, nested in braces along its dimensions
+template <typename T>
+static void print_values(const T *values, const int *dims, int ndims)
+{
+    if (ndims == 1) {
+        cout << "{";
+        for (int i = 0; i < dims[0]; i++) {
+            if (i) cout << ",";
+            print_value(values[i]);
+        }
+        cout << "}";
+        return;
+    }
+    int stride = 1;
+    for (int i = 1; i < ndims; i++)
+        stride *= dims[i];
+    cout << "{";
+    for (int i = 0; i < dims[0]; i++) {
+        if (i) cout << ",";
+        if (ndims == 2) cout << "\n";
+        print_values(values + i * stride, dims + 1, ndims - 1);
+    }
+    cout << "}";
+}
+
+
+// print the definition of a table
+template <typename T>
+static void print_table(string type, string name, const T *values, const int *dims, int ndims)
+{
+    cout << "\nconst " << type << " " << name;
+    for (int i = 0; i < ndims; i++)
+        cout << "[" << dims[i] << "]";
+    cout << " =\n";
+    print_values(values, dims, ndims);
+    cout << ";\n";
+}
+
+
+int main(void) {
+    computeMovesCaptures();
+    computeCapturesTables();
+    computeZobrist();
+
+    const int moves_dims[] = {256, 256, 2};
+    const int captures_dims[] = {256, 256, 2, 8};
+    const int square_dims[] = {64};
+    cout << "// generated by tablegen.cpp; do not edit\n";
+    cout << "#include \"bitboard.h\"\n";
+    print_table("Move", "Moves", &moves[0][0][0], moves_dims, 3);
+    print_table("Capture", "Captures", &captures[0][0][0][0], captures_dims, 4);
+    print_table("unsigned char", "CapturesOffsetUpright", offsetUpright, square_dims, 1);
+    print_table("unsigned char", "CapturesOffsetRotate90", offsetRotate90, square_dims, 1);
+    print_table("unsigned char", "CapturesOffsetRotate45CW", offsetRotate45CW, square_dims, 1);
+    print_table("unsigned char", "CapturesOffsetRotate45CCW", offsetRotate45CCW, square_dims, 1);
+    print_table("unsigned char", "CapturesLengthRotate45CW", lengthRotate45CW, square_dims, 1);
+    print_table("unsigned char", "CapturesLengthRotate45CCW", lengthRotate45CCW, square_dims, 1);
+    print_table("unsigned char", "CapturesIndexUpright", indexUpright, square_dims, 1);
+    print_table("unsigned char", "CapturesIndexRotate90", indexRotate90, square_dims, 1);
+    print_table("unsigned char", "CapturesIndexRotate45CW", indexRotate45CW, square_dims, 1);
+    print_table("unsigned char", "CapturesIndexRotate45CCW", indexRotate45CCW, square_dims, 1);
+    const int zobrist_square_dims[] = {2, 64};
+    const int zobrist_state_dims[] = {8};
+    print_table("uint64_t", "ZobristSquare", &zobristSquare[0][0], zobrist_square_dims, 2);
+    print_table("uint64_t", "ZobristFlip", zobristFlip, square_dims, 1);
+    print_table("uint64_t", "ZobristState", zobristState, zobrist_state_dims, 1);
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include "timeman.h"
+
+using namespace std;
+
+
+// the best move is clear if it has this many times more visits than the runner-up
+static const double CLEAR_LEAD = 2.0;
+// ... and so clear that the search stops at half the soft limit at this lead
+static const double OBVIOUS_LEAD = 8.0;
+// a move may run on to this many times its soft limit when the best move is unclear
+static const double HARD_FACTOR = 3.0;
+// but never use more than this fraction of the remaining time on one move
+static const double MAX_FRACTION = 0.25;
+// seconds kept in reserve for the overhead outside of the search
+static const double RESERVE = 0.05;
+
+
+// constructor
+TimeManager::TimeManager(double total) : left(total), soft(0), hard(0) {}
+
+
+// middle game moves decide most games, so they get more time than opening and endgame moves
+double TimeManager::weight(int empties)
+{
+    if (empties > 44) return 1.0;
+    if (empties > 16) return 1.5;
+    return 1.0;
+}
+
+
+// start timing a move, and set its limits from the weights of all our remaining moves
+void TimeManager::start(int empties)
+{
+    started = chrono::steady_clock::now();
+    // we play about every other move from here on
+    double total_weight = 0;
+    for (int e = empties; e > 0; e -= 2)
+        total_weight += weight(e);
+    double available = max(0.0, left - RESERVE);
+    soft = available * weight(empties) / max(total_weight, 1.0);
+    hard = min(soft * HARD_FACTOR, available * MAX_FRACTION);
+    hard = max(hard, soft);
+}
+
+
+// seconds since the move started
+double TimeManager::elapsed(void)
+{
+    chrono::duration<double> e = chrono::steady_clock::now() - started;
+    return e.count();
+}
+
+
+// stop at the hard limit, at the soft limit if the best move is clear,
+// and at half the soft limit if the best move is obvious
+bool TimeManager::should_stop(double lead)
+{
+    double e = elapsed();
+    if (e >= hard) return true;
+    if (e >= soft && lead >= CLEAR_LEAD) return true;
+    if (e >= soft / 2 && lead >= OBVIOUS_LEAD) return true;
+    return false;
+}
+
+
+// charge the move to the clock
+void TimeManager::stop(void)
+{
+    left -= elapsed();
+}
+
+
+// seconds left on the clock
+double TimeManager::remaining(void)
+{
+    return left;
+}
@@ -0,0 +1,39 @@
+#ifndef TIMEMAN_H
+#define TIMEMAN_H
+
+#include <chrono>
+
+
+// splits a game clock over the moves of one player
+// every move gets a share of the remaining time weighted by game phase (a soft limit),
+// and may stop early when the best move is clear or run on to a hard limit when it is not
+class TimeManager {
+public:
+    // constructor: total is the clock for all of the player's moves in the game, in seconds
+    TimeManager(double total);
+    // start timing a move in a position with the given number of empty squares
+    void start(int empties);
+    // seconds since the move started
+    double elapsed(void);
+    // whether the search should stop now; lead is how many times more visits the best
+    // move has than the runner-up (a large number if there is no runner-up)
+    bool should_stop(double lead);
+    // stop timing the move and charge the time it took to the clock
+    void stop(void);
+    // seconds left on the clock
+    double remaining(void);
+
+private:
+    // seconds left on the clock, as of the start of the current move
+    double left;
+    // limits for the current move, in seconds
+    double soft;
+    double hard;
+    // when the current move started
+    std::chrono::steady_clock::time_point started;
+    // relative weight of a move made with the given number of empty squares
+    static double weight(int empties);
+};
+
+
+#endif
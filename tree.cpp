@@ -0,0 +1,193 @@
+#include <new>
+#include <cstdint>
+#include "tree.h"
+
+using namespace std;
+
+
+// constructor
+NodeArena::NodeArena(size_t max_bytes, bool shared) : next(NULL), left(0), free_nodes(0), shared(shared)
+{
+    max_slabs = max_bytes / (SLAB_NODES * BLOCK_SLOT);
+    if (max_bytes == 0) max_slabs = SIZE_MAX;
+    else if (max_slabs == 0) max_slabs = 1;
+    for (int i = 0; i <= MAX_BLOCK; i++)
+        free_blocks[i] = NULL;
+}
+
+
+// destructor
+NodeArena::~NodeArena()
+{
+    for (auto slab : slabs)
+        ::operator delete(slab);
+}
+
+
+// allocate a block of nodes, reusing a free block of the same size if there is one
+// when the arena is full, reclaim garbage until there is one, or else split a larger one
+TreeNode *NodeArena::allocate(int size)
+{
+    unique_lock<mutex> guard(lock, defer_lock);
+    if (shared) guard.lock();
+    for (int i = 0; i < RECLAIM_PER_ALLOCATION && !garbage.empty(); i++)
+        reclaim();
+    TreeNode *block = take(size);
+    while (block == NULL && !garbage.empty()) {
+        reclaim();
+        block = take(size);
+    }
+    for (int s = size + 1; block == NULL && s <= MAX_BLOCK; s++) {
+        if (free_blocks[s] == NULL) continue;
+        block = free_blocks[s];
+        free_blocks[s] = block->children;
+        free_nodes -= s;
+        release(reinterpret_cast<TreeNode*>(reinterpret_cast<char*>(block) + size * BLOCK_SLOT), s - size);
+    }
+    if (block == NULL) return NULL;
+    for (int i = 0; i < size; i++)
+        new (&block[i]) TreeNode();
+    atomic<int> *stats = block_chosen(block, size);
+    for (int i = 0; i < 2 * size; i++)
+        new (&stats[i]) atomic<int>(0);
+    return block;
+}
+
+
+// a block of exactly size nodes from the free lists or the slabs, or NULL if the arena is full
+// the end of a slab too short for the block is kept as a free block of its own
+TreeNode *NodeArena::take(int size)
+{
+    TreeNode *block = free_blocks[size];
+    if (block != NULL) {
+        free_blocks[size] = block->children;
+        free_nodes -= size;
+        return block;
+    }
+    if (left < (size_t)size) {
+        if (slabs.size() >= max_slabs) return NULL;
+        if (left > 0) release(reinterpret_cast<TreeNode*>(next), left);
+        next = static_cast<char*>(::operator new(SLAB_NODES * BLOCK_SLOT));
+        left = SLAB_NODES;
+        slabs.push_back(next);
+    }
+    block = reinterpret_cast<TreeNode*>(next);
+    next += size * BLOCK_SLOT;
+    left -= size;
+    return block;
+}
+
+
+// put a block on its free list
+void NodeArena::release(TreeNode *block, int size)
+{
+    block->children = free_blocks[size];
+    free_blocks[size] = block;
+    free_nodes += size;
+}
+
+
+// queue a block for reclamation
+void NodeArena::discard(TreeNode *block, int size)
+{
+    unique_lock<mutex> guard(lock, defer_lock);
+    if (shared) guard.lock();
+    garbage.push_back({block, size});
+}
+
+
+// memory reserved from the system, in bytes
+size_t NodeArena::bytes(void)
+{
+    unique_lock<mutex> guard(lock, defer_lock);
+    if (shared) guard.lock();
+    return slabs.size() * SLAB_NODES * BLOCK_SLOT;
+}
+
+
+// memory in nodes not yet reclaimed, in bytes
+size_t NodeArena::used(void)
+{
+    unique_lock<mutex> guard(lock, defer_lock);
+    if (shared) guard.lock();
+    return (slabs.size() * SLAB_NODES - left - free_nodes) * BLOCK_SLOT;
+}
+
+
+// take apart one garbage block
+void NodeArena::reclaim(void)
+{
+    Block b = garbage.back();
+    garbage.pop_back();
+    for (int i = 0; i < b.size; i++)
+        if (b.nodes[i].num_children > 0)
+            garbage.push_back({b.nodes[i].children, b.nodes[i].num_children});
+    release(b.nodes, b.size);
+}
+
+
+// constructor
+TranspositionTable::TranspositionTable(size_t size) : lookups(0), hits(0), saved_nodes(0), generation(0)
+{
+    size_t buckets = 1;
+    while (buckets * 4 <= size)
+        buckets *= 2;
+    entries = vector<Entry>(buckets * 2);
+    mask = buckets - 1;
+    new_generation();
+}
+
+
+// the expanded node stored for the position with the given key, or NULL
+// the entry may be replaced while it is read, so the node itself must have the key too
+TreeNode *TranspositionTable::find(uint64_t key)
+{
+    Entry *bucket = &entries[(key & mask) * 2];
+    for (int i = 0; i < 2; i++) {
+        if (bucket[i].check.load(memory_order_acquire) != (key ^ salt)) continue;
+        TreeNode *node = bucket[i].node.load(memory_order_acquire);
+        if (node->key == key) return node;
+    }
+    return NULL;
+}
+
+
+// store an expanded node, in place of the same position, a stale entry, or the deeper entry
+void TranspositionTable::insert(TreeNode *node, int discs)
+{
+    Entry *bucket = &entries[(node->key & mask) * 2];
+    Entry *victim = &bucket[0];
+    for (int i = 0; i < 2; i++) {
+        Entry& e = bucket[i];
+        if (e.generation.load(memory_order_relaxed) != generation ||
+            e.check.load(memory_order_relaxed) == (node->key ^ salt)) {
+            victim = &e;
+            break;
+        }
+        if (e.discs.load(memory_order_relaxed) > victim->discs.load(memory_order_relaxed))
+            victim = &e;
+    }
+    victim->generation.store(generation, memory_order_relaxed);
+    victim->discs.store(discs, memory_order_relaxed);
+    victim->node.store(node, memory_order_release);
+    victim->check.store(node->key ^ salt, memory_order_release);
+}
+
+
+// forget every entry: the entries of older generations no longer match any key
+void TranspositionTable::new_generation(void)
+{
+    generation++;
+    // splitmix64 of the generation
+    uint64_t z = generation * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    salt = z ^ (z >> 31);
+}
+
+
+// memory used by the entries, in bytes
+size_t TranspositionTable::bytes(void)
+{
+    return entries.size() * sizeof(Entry);
+}
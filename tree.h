@@ -0,0 +1,190 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+// states of TreeNode::expanded
+// a LINKED node has no children of its own: it shares those of the EXPANDED node of the
+// same position, found through a TranspositionTable by its key
+enum { LEAF, EXPANDING, EXPANDED, LINKED };
+
+// TreeNode::proven of a node whose outcome has not been proven
+enum { UNPROVEN = 2 };
+
+
+struct TreeNode;
+
+// a block of n nodes (the children of one node, or a root) takes n slots of BLOCK_SLOT bytes:
+// the n nodes, then the visit counts of all of them, then their reward sums, so that
+// selection reads the statistics of all children as two arrays
+enum { BLOCK_SLOT = 32 };
+
+// the visit counts of the nodes of a block of size nodes; their reward sums follow
+inline std::atomic<int> *block_chosen(TreeNode *block, int size);
+inline std::atomic<int> *block_rewards(TreeNode *block, int size);
+
+
+// TreeNode is used to expand MC tree structure
+// the statistics are atomic so that several threads can search one tree (PARALLEL_TREE)
+// the children of a node are one contiguous block of nodes allocated from a NodeArena, and
+// the number of rollouts where a node is chosen by its parent and its net number of wins
+// are kept in the arrays of its block
+struct TreeNode {
+    TreeNode *children;             // block of child positions, complete once expanded == EXPANDED
+    uint64_t key;                   // hash of the position, set when there is a transposition table
+    std::atomic<int> base;          // number of rollouts involving the children (their parent count)
+    std::atomic<uint8_t> expanded;  // LEAF, EXPANDING (by some thread), EXPANDED or LINKED
+    int8_t move;                    // move leading from parent position to current position
+    uint8_t num_children;           // number of nodes in the block
+    std::atomic<int8_t> proven;     // outcome with perfect play once proven by the solver, or UNPROVEN
+
+    // iterate over the children with for (TreeNode& child : *node)
+    TreeNode *begin(void) { return children; }
+    TreeNode *end(void) { return children + num_children; }
+    // the statistics of the children, indexed like them
+    std::atomic<int> *child_chosen(void) { return block_chosen(children, num_children); }
+    std::atomic<int> *child_rewards(void) { return block_rewards(children, num_children); }
+};
+
+static_assert(sizeof(TreeNode) + 2 * sizeof(std::atomic<int>) == BLOCK_SLOT, "a node and its statistics fill a slot");
+
+
+inline std::atomic<int> *block_chosen(TreeNode *block, int size)
+{
+    return reinterpret_cast<std::atomic<int>*>(block + size);
+}
+
+
+inline std::atomic<int> *block_rewards(TreeNode *block, int size)
+{
+    return block_chosen(block, size) + size;
+}
+
+
+// one step of the path of an MCTS iteration from the root: the node and its reward sum, the
+// node whose children it searched (itself, or the node it is linked to), the index of the
+// child chosen, and the side to move (1 for black, -1 for white)
+struct PathStep {
+    TreeNode *node;
+    std::atomic<int> *rewards;
+    TreeNode *source;
+    int child;
+    int sign;
+};
+
+// the longest path: a game has at most 60 moves, and a pass is always followed by a move
+enum { MAX_PATH = 128 };
+
+
+// allocates the child blocks of TreeNodes from large slabs
+// freed blocks are kept on free lists by size, and discarded subtrees are queued as
+// garbage that later allocations take apart a few blocks at a time, so that discarding
+// a subtree costs O(1) however large it is; the slabs are all freed with the arena
+// an arena may be limited in size: once it is full, allocations take apart all the garbage
+// and split larger free blocks if they must, and fail if there is still no room
+// an arena must only be used by one thread at a time, unless it is shared: then allocations
+// and discards may run on several threads at once, one after another under a lock
+class NodeArena {
+public:
+    // constructor: max_bytes limits the memory reserved from the system (at least one
+    // slab is always allowed), or 0 for no limit
+    NodeArena(size_t max_bytes = 0, bool shared = false);
+    // destructor: frees every slab, and thus every node, at once
+    ~NodeArena();
+    // allocate a block of size value-initialized nodes (1 <= size <= MAX_BLOCK) with zeroed
+    // statistics, or return NULL if the arena is full
+    TreeNode *allocate(int size);
+    // give back a block of size nodes together with all of their descendants
+    void discard(TreeNode *block, int size);
+    // memory reserved from the system, in bytes (under the lock if shared)
+    size_t bytes(void);
+    // memory in nodes not yet reclaimed, in bytes (under the lock if shared)
+    size_t used(void);
+
+    // the largest block: more children than any position has moves
+    static const int MAX_BLOCK = 64;
+
+private:
+    // number of slots (one per node) in a slab
+    static const size_t SLAB_NODES = 32768;
+    // number of garbage blocks taken apart by every allocation
+    static const int RECLAIM_PER_ALLOCATION = 2;
+    // a block of nodes waiting to be reclaimed
+    struct Block {
+        TreeNode *nodes;
+        int size;
+    };
+    // all slabs, the unused part of the last one in slots, and how many slabs there may be
+    std::vector<char*> slabs;
+    char *next;
+    size_t left;
+    size_t max_slabs;
+    // free blocks by size, linked through the children pointer of their first node
+    TreeNode *free_blocks[MAX_BLOCK + 1];
+    // number of slots in all the free blocks
+    size_t free_nodes;
+    // discarded blocks whose descendants have not been queued yet
+    std::vector<Block> garbage;
+    // whether several threads use the arena, and the lock they take turns with
+    bool shared;
+    std::mutex lock;
+    // a block of exactly size nodes from the free lists or the slabs, or NULL if the
+    // arena is full
+    TreeNode *take(int size);
+    // put a block on its free list
+    void release(TreeNode *block, int size);
+    // take apart one garbage block: queue its children's blocks and free the block
+    void reclaim(void);
+};
+
+
+// finds the expanded node of a position by its hash, so that the nodes reached by different
+// move orders (transpositions) can share one block of children
+// the table has a fixed number of buckets of two entries; a new entry replaces one from an
+// earlier generation if there is one, and otherwise the one deeper in the game, whose
+// subtree is smaller; starting a new generation forgets every entry at once, which must be
+// done whenever nodes are discarded
+// lookups and insertions may run on several threads at once
+class TranspositionTable {
+public:
+    // constructor: room for the given number of entries, rounded down to a power of two
+    TranspositionTable(size_t size);
+    // the expanded node stored for the position with the given key, or NULL
+    TreeNode *find(uint64_t key);
+    // store an expanded node, whose key must be set; discs is the number of pieces on the board
+    void insert(TreeNode *node, int discs);
+    // forget every entry
+    void new_generation(void);
+    // memory used by the entries, in bytes
+    size_t bytes(void);
+
+    // statistics, counted by the search: expansions that looked for a transposition, how
+    // many of them found one, and how many nodes the links did not have to allocate
+    std::atomic<uint64_t> lookups;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> saved_nodes;
+
+private:
+    // the node is only valid if check is the key of the node xor the salt of the current
+    // generation; check is written last, so a reader that sees it sees the rest as well
+    struct Entry {
+        std::atomic<uint64_t> check;
+        std::atomic<TreeNode*> node;
+        std::atomic<uint32_t> generation;
+        std::atomic<uint32_t> discs;
+    };
+    std::vector<Entry> entries;
+    // selects the bucket from a key
+    uint64_t mask;
+    // the current generation, and the salt mixed into its keys
+    uint32_t generation;
+    uint64_t salt;
+};
+
+
+#endif
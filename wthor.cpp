@@ -0,0 +1,85 @@
+#include <fstream>
+#include <string>
+#include <vector>
+#include "bitboard.h"
+#include "position.h"
+#include "wthor.h"
+
+using namespace std;
+
+
+// path of the .wtb file for the given year
+string wtb_file(int year)
+{
+    return "./database/WTH_" + to_string(year) + ".wtb";
+}
+
+
+// read a .wtb file and add all the games in there
+void parse_wtb(vector<Game> &games, string file) {
+    ifstream input(file, ifstream::binary);
+
+    // skip the first 16 bytes of the file
+    char c;
+    for (int i = 0; i < 16; i++)
+        input.get(c);
+
+    // read 68 bytes at a time and ignore the first 8 bytes
+    while (true) {
+        Game new_game;
+        for (int i = 0; i < 8; i++)
+            if (!input.get(c)) {
+                input.close();
+                return;
+            }
+        for (int i = 0; i < 60; i++) {
+            input.get(c);
+            if (c == 0) {
+                new_game.push_back(-1);
+                continue;
+            }
+            int row, col;
+            col = (int)c % 10 - 1;
+            row = 8 - (int)c / 10;
+            new_game.push_back(row * 8 + col);
+        }
+        games.push_back(new_game);
+    }
+
+    input.close();
+}
+
+
+// replay a game with every pass made explicit, and return its outcome
+int rectify_game(const Game &game, Game &rectified)
+{
+    Position position = Position();
+    int outcome = 2; // 2: undefined
+    for (size_t m = 0; m < game.size(); m++) {
+        int move = game[m];
+        Color side = (Color)position.whose_turn();
+        Bitboard moves_bb = position.generate_moves(side);
+        if (moves_bb == 0) {
+            position.make_move(-1, side);
+            m--; // current game[m] belongs to the other player
+            rectified.push_back(-1);
+        } else {
+            position.make_move(move, side);
+            rectified.push_back(move);
+        }
+        if (position.game_over()) {
+            outcome = position.outcome();
+            break;
+        }
+    }
+    // there are special cases where the game is not over (presumably because one side resigned)
+    if (!position.game_over()) {
+        position.make_move(-1, (Color)position.whose_turn());
+        outcome = position.outcome();
+    }
+    // remove all the trailing passes
+    while (rectified.back() == -1) {
+        rectified.pop_back();
+    }
+    return outcome;
+}
@@ -0,0 +1,28 @@
+#ifndef WTHOR_H
+#define WTHOR_H
+
+#include <string>
+#include <vector>
+
+
+// A "Game" object is defined as a sequence of moves
+typedef std::vector<int> Game;
+
+// the years covered by the .wtb files in the database folder
+const int WTHOR_FIRST_YEAR = 1977;
+const int WTHOR_LAST_YEAR = 2020;
+
+// path of the .wtb file for the given year
+std::string wtb_file(int year);
+
+// read a .wtb file and add all the games in there
+// the games omit passes, since WTHOR only records the moves that were played
+void parse_wtb(std::vector<Game> &games, std::string file);
+
+// replay a game from the database and write it into rectified with every pass made
+// explicit (-1), so that moves always alternate black/white, and with no trailing passes
+// returns the outcome of the game (1, 0 or -1 from black's point of view)
+int rectify_game(const Game &game, Game &rectified);
+
+
+#endif